@@ -2,13 +2,38 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
+// Kod maszynowy emitujemy tylko na x86-64 z konwencją wywołań System V i mmap, gdzie indziej
+// (także na Win64, gdzie argumenty przychodzą w innych rejestrach) netlisty liczy interpreter
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_SYSV
+#endif
+#if defined(JIT_SYSV)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 typedef struct output_destinations outList_t;
-typedef struct input_origins origin_t;
+typedef struct gather_run run_t;
+typedef struct worker_pool pool_t;
+typedef struct work_deque deque_t;
+typedef struct step_job job_t;
+typedef struct handle_slot slot_t;
+typedef struct block_layout layout_t;
+typedef struct arena_chunk arena_t;
+typedef struct spare_block spare_t;
+typedef struct group_run grun_t;
+typedef struct family family_t;
+typedef struct table table_t;
+typedef struct gate gate_t;
+typedef struct program program_t;
 
 // Liczy ile uintów trzeba żeby przechować x bitów w size_t razy wielkość uinta
 #define SIZEOF_64_UINT(x) (sizeof(uint64_t) * ((x + 63) / 64))
@@ -16,18 +41,58 @@ typedef struct input_origins origin_t;
 // Liczy ile uintów trzeba, żeby przechować x bitów w size_t
 #define CEIL64(x) ((x + 63) / 64)
 
+// To samo co CEIL64, ale bez przepełnienia dla x bliskich SIZE_MAX
+#define WORDS64(x) ((x) / 64 + ((x) % 64 != 0))
+
+// Rozmiar linii pamięci podręcznej, do której wyrównujemy części bloku automatu
+#define CACHE_LINE 64
+
 #define IS_1(x, n) (((x) & (1ULL << (n))) != 0)
 #define SET_1(x, n) (x | (1ULL << (n)))
 #define SET_0(x, n) (x & ~(1ULL << (n)))
 #define COPY(x, y, n, k) (IS_1(y, k) ? SET_1(x, n) : SET_0(x, n)) //ustawia n-ty bit x-a na k-ty bit y-ka
 
+// Rozmiar przekazywany funkcjom użytkownika: w automacie bit-sliced liczony w słowach, a nie bitach
+#define USER_WIDTH(a, x) ((a)->sliced ? (x) / 64 : (x))
+
+// Maska z len najmłodszymi bitami ustawionymi na 1, dla 0 < len <= 64
+#define LOW_MASK(len) ((len) == 64 ? UINT64_MAX : (1ULL << (len)) - 1)
+
 struct moore {
+    void *block; // początek jedynej alokacji automatu, struktura leży w nim wyrównana do linii
     size_t n,m,s; // liczba wejść, wyjść, stanów
-    uint64_t *input, *output, *state, *new_state;
+    uint64_t *input, *output, *state, *new_state; // state i new_state zamieniają się po każdym kroku
+    uint64_t *scratch; // tu liczymy nowe wyjście, żeby porównać je ze starym
+    uint64_t *dirty; // słowa wyjścia zmienione przy ostatnim przeliczeniu, ważne gdy wersja wzrosła o 1
     transition_function_t transition;
     output_function_t output_function;
     outList_t *head; // wskaźnik na początek listy podłączeń
-    origin_t *origins; // wskaźnik na tablicę, bitów mówiącą które inputy są podłączone
+    outList_t **fan; // tablica haszująca node'y listy podłączeń po automacie docelowym, fan_cap to potęga dwójki
+    size_t fan_len, fan_cap;
+    run_t *plan; // połączenia wejść jako posortowane po dst_bit, rozłączne fragmenty
+    size_t plan_len, plan_cap;
+    uint64_t *wired; // bity wejść faktycznie podłączonych, zasłaniają dziury po ma_disconnect w planie
+    uint64_t *staged; // wartości wepchnięte przez źródła w trybie push, trafiają do input przy zbieraniu wejść,
+                      // NULL dopóki żadne źródło nie zaczęło wpychać
+    uint64_t *staged_bits, *staged_words; // bity staged czekające na przepisanie i słowa, w których leżą
+    unsigned long stamp; // numer ostatniego wywołania ma_step, w którym automat wystąpił
+    uint32_t slot; // miejsce automatu w tablicy uchwytów
+    ma_network_t *net; // sieć, w której arenie leży automat, albo NULL
+    size_t net_index; // miejsce automatu w tablicy members sieci
+    bool output_valid; // czy output odpowiada aktualnemu stanowi
+    unsigned flags; // MA_TIME_DEPENDENT, MA_PURE
+    unsigned long out_version; // rośnie o 1 przy przeliczeniu z mapą dirty, wpp. o 2
+    unsigned long in_sum; // suma out_version źródeł przy ostatnim zbieraniu wejść
+    bool input_dirty; // wejście lub połączenia zmieniły się od ostatniego przejścia
+    bool settled; // ostatnie przejście nie zmieniło stanu
+    bool push; // zmienione słowa wyjścia wpychamy od razu do staged odbiorców
+    family_t *family; // rodzina, której wspólne tablice trzymają input, state i new_state, albo NULL
+    bool sliced; // każdy bit logiczny to słowo 64 niezależnych scenariuszy, n, m, s liczą bity fizyczne
+    table_t *table; // tablice przejść i wyjść zamiast funkcji użytkownika, albo NULL
+    program_t *program; // skompilowana netlista zamiast funkcji użytkownika, albo NULL
+    uint64_t *regs; // rejestry programu netlisty, osobne dla każdego automatu
+    bool native; // program liczymy kodem maszynowym
+    size_t family_index;
 };
 
 
@@ -35,46 +100,377 @@ struct moore {
 struct output_destinations { // jeden node w tej liście odpowiada połączeniu z jednym automatem
     size_t num; // ile jest bitów podłączonych do tego automatu
     moore_t * ma; // do jakiego automatu jesteśmy podłączeni
+    size_t lo, hi; // wejścia tego automatu zasilane przez nas leżą w [lo, hi)
     outList_t *next;
     outList_t *prev;
 };
 
-// Struktura przechowująca z wyjśćia jakiego automatu pochodzi poszczególny bit, ma = NULL kiedy jest oryginalny
-struct input_origins {
-    size_t out;
+// Ciągły fragment wejść zasilany z ciągłego fragmentu wyjść jednego automatu. Wskaźnik src
+// wolno czytać tylko dopóki generacja w miejscu slot tablicy uchwytów jest równa gen.
+struct gather_run {
+    moore_t *src;
+    uint32_t slot, gen;
+    size_t src_bit, dst_bit, len;
+    unsigned long seen; // out_version źródła przy ostatnim kopiowaniu
+};
+
+// Przesunięcia części automatu względem początku jego bloku
+struct block_layout {
+    size_t total; // SIZE_MAX, jeśli rozmiar się przepełnił
+    size_t head, input, wired, output, state, new_state, scratch, dirty;
+};
+
+// Kawałek areny sieci, pamięć na bloki automatów zaczyna się w base
+struct arena_chunk {
+    arena_t *next;
+    size_t size, used;
+    char *base;
+};
+
+// Blok usuniętego automatu sieci czekający na ponowne użycie, nagłówek leży w samym bloku
+struct spare_block {
+    spare_t *next;
+    size_t size;
+};
+
+// Sieć automatów. Bloki automatów leżą kolejno w kawałkach areny, bloki usuniętych automatów
+// (poza członkami rodzin) trafiają na listę spare i dostają je nowe automaty o tym samym rozmiarze.
+// Członkowie mają różne rozmiary i są liczeni pojedynczo, więc każdy zachowuje swój blok z wejściem,
+// stanem i wyjściem w sąsiednich liniach. Tablice wspólne dla wielu automatów (struct-of-arrays)
+// mają tylko rodziny, których członkowie mają te same rozmiary i liczą się jednym wywołaniem.
+struct network {
+    arena_t *arena; // ostatnio dodany kawałek jest na początku
+    spare_t *spare;
+    size_t len, cap;
+    moore_t **members;
+    int push; // MA_PUSH_OFF, MA_PUSH_ON albo MA_PUSH_AUTO
+    unsigned long push_epoch; // wiring_epoch, dla którego wybrano producentów w trybie MA_PUSH_AUTO
+    family_t *families;
+};
+
+// Rodzina k automatów sieci o tych samych rozmiarach i wsadowej funkcji przejścia. Wejścia i stany
+// członka j leżą w ciągłych tablicach rodziny od słowa j * WORDS64(n) albo j * WORDS64(s).
+// Przy kroku całej rodziny tablice state i new_state zamieniają się dla wszystkich naraz.
+struct family {
+    batch_transition_function_t batch;
+    size_t k, n, s, live;
+    uint64_t *input, *state, *new_state;
+    moore_t **members; // NULL na miejscu usuniętego członka
+    family_t *next;
+};
+
+// Tablice automatu tablicowego, wspólne dla automatów o tych samych rozmiarach i zawartości.
+// next[input | state << n] to nowy stan, out[state] to wyjście.
+struct table {
+    size_t refs, n, m, s;
+    uint64_t hash;
+    uint64_t *out;
+    uint16_t *next;
+    table_t *link;
+};
+
+// Fragment planu grupy z już odczytanym wskaźnikiem na wyjście źródła
+struct group_run {
+    moore_t const *src;
+    size_t src_bit, dst_bit, len;
+    unsigned long seen;
+};
+
+// Przygotowana grupa automatów do wielokrotnego liczenia kroków
+struct step_group {
+    moore_t **at;
+    size_t num;
+    bool distinct; // czy żaden automat nie powtarza się w at
+    uint32_t *slot, *gen; // uchwyty członków, żeby wykryć usunięcie bez czytania ich pamięci
+    grun_t *runs; // fragmenty planów wszystkich członków, at[i] ma fragmenty [first[i], first[i + 1])
+    size_t *first;
+    size_t runs_cap;
+    unsigned long epoch; // wiring_epoch, dla którego policzono plan
+    bool dead; // któryś członek został usunięty
+};
+
+// Miejsce w tablicy uchwytów, generacja rośnie przy każdym usunięciu automatu
+struct handle_slot {
     moore_t *ma;
-    outList_t *dest; // Wskaźnik na listę outList_t dla łatwiejszego usuwania
+    uint32_t gen;
+    uint32_t next_free;
+};
+
+// Zlecenie dla puli: steps kroków na tablicy at
+struct step_job {
+    moore_t **at;
+    size_t num, steps;
+    step_callback_t callback;
+    void *arg;
+    int schedule; // MA_SCHED_STATIC albo MA_SCHED_STEAL
+    ma_group_t *group; // grupa, której planem zbieramy wejścia, albo NULL
+};
+
+// Stała pula wątków wykonujących obie fazy ma_step, wspólna dla całej biblioteki
+struct worker_pool {
+    size_t size; // liczba wątków razem z wywołującym ma_step
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_barrier_t barrier; // rozdziela fazę przejść od fazy wyjść i kończy krok
+    unsigned long round; // numer ostatniego zlecenia
+    bool stop;
+    job_t job; // ostatnie zlecenie, wątki kopiują je pod zamkiem przy budzeniu
+    deque_t *deques[2]; // kolejki wątków osobno dla fazy przejść i fazy wyjść
+    size_t *steals; // liczba udanych kradzieży każdego wątku
+};
+
+// Kolejka pracy jednego wątku: przedział indeksów [lo, hi) spakowany w jedno słowo, żeby
+// właściciel (od dołu) i złodzieje (od góry) mogli go zmieniać jednym compare-and-swap
+struct work_deque {
+    _Atomic uint64_t range;
+    char pad[64 - sizeof(uint64_t)]; // każda kolejka w osobnej linii pamięci podręcznej
+};
+
+static pool_t *pool = NULL;
+static unsigned long step_stamp = 0;
+static int schedule = MA_SCHED_STATIC;
+static unsigned long wiring_epoch = 0; // rośnie przy każdej zmianie połączeń i usunięciu automatu
+static bool event_driven = false;
+static bool jit_enabled = false; // czy kompilować netlisty do kodu maszynowego
+
+// Liczba node'ów w jednym kawałku puli
+#define NODE_SLAB 64
+
+typedef struct node_slab slab_t;
+
+// Kawałek pamięci na NODE_SLAB node'ów listy podłączeń
+struct node_slab {
+    slab_t *next;
+    outList_t nodes[NODE_SLAB];
 };
 
-// Tworzy listę z atrapą na początku
-outList_t* create() {
-    outList_t* head = (outList_t*)calloc(1,sizeof(outList_t));
-    if (!head) {
+// Wspólna dla biblioteki pula node'ów: wolne node'y są połączone przez pole next
+static struct {
+    slab_t *slabs;
+    outList_t *free;
+    size_t live; // ile node'ów jest wydanych
+} node_pool;
+
+// Wydaje node'a z puli, dokładając nowy kawałek gdy wolnych brak, NULL dla nieudanej alokacji
+static outList_t* node_acquire(void) {
+    if (!node_pool.free) {
+        slab_t *slab = (slab_t*)malloc(sizeof(slab_t));
+        if (!slab) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        slab->next = node_pool.slabs;
+        node_pool.slabs = slab;
+        for (size_t i = 0; i < NODE_SLAB; i++) {
+            slab->nodes[i].next = node_pool.free;
+            node_pool.free = &slab->nodes[i];
+        }
+    }
+    outList_t *node = node_pool.free;
+    node_pool.free = node->next;
+    node_pool.live++;
+    return node;
+}
+
+// Oddaje node'a do puli. Pamięć zostaje w puli dla kolejnych ma_connect.
+static void node_release(outList_t *node) {
+    node->next = node_pool.free;
+    node_pool.free = node;
+    node_pool.live--;
+}
+
+// Zwalnia pamięć puli po usunięciu ostatniego automatu, kiedy nie ma już wydanych node'ów
+static void node_pool_trim(void) {
+    if (node_pool.live) return;
+    while (node_pool.slabs) {
+        slab_t *slab = node_pool.slabs;
+        node_pool.slabs = slab->next;
+        free(slab);
+    }
+    node_pool.free = NULL;
+}
+
+// Wszystkie tablice automatów tablicowych, każda zawartość występuje raz
+static table_t *tables = NULL;
+
+// Zwraca tablice o podanej zawartości, dzieląc je z automatami, które już je mają.
+// Nadmiarowe bity wpisów są zerowane, NULL dla nieudanej alokacji.
+static table_t* table_acquire(size_t n, size_t m, size_t s, uint16_t const *next, uint64_t const *out) {
+    size_t states = (size_t)1 << s, entries = (size_t)1 << (n + s);
+    table_t *t = (table_t*)malloc(sizeof(table_t) + states * sizeof(uint64_t) + entries * sizeof(uint16_t));
+    if (!t) {
         errno = ENOMEM;
         return NULL;
     }
-    head->next = NULL;
-    head->prev = NULL;
-    head->ma = NULL;
-    return head;
+    t->refs = 1;
+    t->n = n;
+    t->m = m;
+    t->s = s;
+    t->out = (uint64_t*)(t + 1);
+    t->next = (uint16_t*)(t->out + states);
+    // FNV-1a po wpisach, żeby porównywać pamięć tylko przy zgodnym skrócie
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < states; i++) {
+        t->out[i] = out[i] & LOW_MASK(m);
+        hash = (hash ^ t->out[i]) * 0x100000001b3ULL;
+    }
+    for (size_t i = 0; i < entries; i++) {
+        t->next[i] = next[i] & (uint16_t)LOW_MASK(s);
+        hash = (hash ^ t->next[i]) * 0x100000001b3ULL;
+    }
+    t->hash = hash;
+    for (table_t *o = tables; o; o = o->link) {
+        if (o->hash == hash && o->n == n && o->m == m && o->s == s &&
+            !memcmp(o->out, t->out, states * sizeof(uint64_t)) &&
+            !memcmp(o->next, t->next, entries * sizeof(uint16_t))) {
+            free(t);
+            o->refs++;
+            return o;
+        }
+    }
+    t->link = tables;
+    tables = t;
+    return t;
+}
+
+// Oddaje tablice automatu, zwalniając je razem z ostatnim użytkownikiem
+static void table_release(table_t *t) {
+    if (--t->refs) return;
+    table_t **at = &tables;
+    while (*at != t) at = &(*at)->link;
+    *at = t->link;
+    free(t);
 }
 
-// Dodaje na drugie miejsce w liście node'a, zwraca -1 dla nieudanej alokacji pamięci
-outList_t* add_node(outList_t* head, moore_t* ma){
-    outList_t *temp = head;
-    while (temp) {
-        if (temp->ma == ma) {
-            return temp;
+#define NO_SLOT UINT32_MAX
+
+// Tablica uchwytów automatów, zwalniana gdy nie ma już żadnego automatu
+static struct {
+    slot_t *slots;
+    size_t len, cap, live;
+    size_t groups; // grupy pamiętają generacje, więc tablica musi przeżyć razem z nimi
+    uint32_t free; // początek listy wolnych miejsc
+} handles = {NULL, 0, 0, 0, 0, NO_SLOT};
+
+// Przydziela automatowi ma miejsce w tablicy uchwytów, -1 dla nieudanej alokacji
+static int handle_acquire(moore_t *ma) {
+    if (handles.free == NO_SLOT) {
+        if (handles.len == handles.cap) {
+            size_t cap = handles.cap ? 2 * handles.cap : 64;
+            if (cap > NO_SLOT) {
+                errno = ENOMEM;
+                return -1;
+            }
+            slot_t *slots = (slot_t*)realloc(handles.slots, cap * sizeof(slot_t));
+            if (!slots) {
+                errno = ENOMEM;
+                return -1;
+            }
+            handles.slots = slots;
+            handles.cap = cap;
         }
-        temp = temp->next;
+        handles.slots[handles.len].gen = 0;
+        handles.slots[handles.len].next_free = NO_SLOT;
+        handles.free = (uint32_t)handles.len++;
     }
-    outList_t* node = (outList_t*)malloc(sizeof(outList_t));
-    if (!node) {
+    ma->slot = handles.free;
+    handles.free = handles.slots[ma->slot].next_free;
+    handles.slots[ma->slot].ma = ma;
+    handles.live++;
+    return 0;
+}
+
+// Zwalnia tablicę uchwytów, kiedy nie ma już automatów ani grup
+static void handles_trim(void) {
+    if (handles.live || handles.groups) return;
+    free(handles.slots);
+    handles.slots = NULL;
+    handles.len = handles.cap = 0;
+    handles.free = NO_SLOT;
+}
+
+// Zwalnia miejsce automatu. Nowa generacja unieważnia wszystkie fragmenty planów, które go wskazują.
+static void handle_release(moore_t *ma) {
+    slot_t *slot = &handles.slots[ma->slot];
+    slot->ma = NULL;
+    slot->gen++;
+    slot->next_free = handles.free;
+    handles.free = ma->slot;
+    handles.live--;
+    handles_trim();
+}
+
+// Czy automat, z którego pochodzi fragment, wciąż istnieje
+static inline bool run_live(run_t const *run) {
+    return handles.slots[run->slot].gen == run->gen;
+}
+
+// Zwraca miejsce w tablicy haszującej o rozmiarze cap, od którego zaczynamy szukać node'a do ma
+static inline size_t fan_home(moore_t const *ma, size_t cap) {
+    // Automaty są wyrównane do linii, więc najmłodsze bity adresu nic nie mówią
+    return (size_t)(((uintptr_t)ma / CACHE_LINE) * 0x9E3779B97F4A7C15ULL) & (cap - 1);
+}
+
+// Zwraca miejsce node'a do automatu ma w tablicy haszującej fan, albo puste miejsce, na które by trafił
+static size_t fan_slot(outList_t *const *fan, size_t cap, moore_t const *ma) {
+    size_t i = fan_home(ma, cap);
+    while (fan[i] && fan[i]->ma != ma) i = (i + 1) & (cap - 1);
+    return i;
+}
+
+// Zapewnia w tablicy haszującej a miejsce na jeszcze jeden node, wypełnienie najwyżej do połowy
+static int fan_reserve(moore_t *a) {
+    if (2 * (a->fan_len + 1) <= a->fan_cap) return 0;
+    size_t cap = a->fan_cap ? 2 * a->fan_cap : 8;
+    outList_t **fan = (outList_t**)calloc(cap, sizeof(outList_t*));
+    if (!fan) {
         errno = ENOMEM;
-        return NULL;
+        return -1;
+    }
+    for (size_t i = 0; i < a->fan_cap; i++)
+        if (a->fan[i]) fan[fan_slot(fan, cap, a->fan[i]->ma)] = a->fan[i];
+    free(a->fan);
+    a->fan = fan;
+    a->fan_cap = cap;
+    return 0;
+}
+
+// Usuwa node'a z tablicy haszującej a, przesuwając wstecz dalsze node'y z tego samego ciągu
+static void fan_remove(moore_t *a, outList_t const *node) {
+    size_t mask = a->fan_cap - 1, i = fan_slot(a->fan, a->fan_cap, node->ma);
+    a->fan[i] = NULL;
+    for (size_t j = (i + 1) & mask; a->fan[j]; j = (j + 1) & mask) {
+        // Node z miejsca j może zająć dziurę i, jeśli jego miejsce startowe nie leży w (i, j]
+        size_t home = fan_home(a->fan[j]->ma, a->fan_cap);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            a->fan[i] = a->fan[j];
+            a->fan[j] = NULL;
+            i = j;
+        }
     }
+    a->fan_len--;
+}
+
+// Zwraca node'a połączenia a_out z ma albo NULL, jeśli a_out nigdy nie zasilał ma
+static outList_t* find_node(moore_t const *a_out, moore_t const *ma) {
+    if (!a_out->fan_cap) return NULL;
+    return a_out->fan[fan_slot(a_out->fan, a_out->fan_cap, ma)];
+}
+
+// Zwraca node'a połączenia a_out z ma, w razie potrzeby dodając go na drugie miejsce w liście.
+// Zwraca NULL dla nieudanej alokacji pamięci.
+static outList_t* add_node(moore_t* a_out, moore_t* ma){
+    outList_t *found = find_node(a_out, ma);
+    if (found) return found;
+    if (fan_reserve(a_out)) return NULL;
+    outList_t* node = node_acquire();
+    if (!node) return NULL;
+    outList_t *head = a_out->head;
     node->ma = ma;
     node->num = 0;
+    node->lo = SIZE_MAX;
+    node->hi = 0;
     if (head->next) {
         node->next = head->next;
         node->next->prev = node;
@@ -82,22 +478,26 @@ outList_t* add_node(outList_t* head, moore_t* ma){
     else node->next = NULL;
     node->prev = head;
     head->next = node;
+    a_out->fan[fan_slot(a_out->fan, a_out->fan_cap, ma)] = node;
+    a_out->fan_len++;
     return node;
 }
 
 // Usuwa node'a który został przekazany w argumencie funkcji
 void remove_node(outList_t* node) {
-    node->prev = node->next;
+    node->prev->next = node->next;
     if (node->next) node->next->prev = node->prev;
-    free(node);
+    node_release(node);
 }
-// Usuwa całą listę, zwalniając pamięć
+// Usuwa całą listę poza atrapą, która leży w bloku automatu
 void clear_list(outList_t* head) {
-    while (head) {
-        outList_t *temp = head;
-        head = head->next;
-        free(temp);
+    outList_t *node = head->next;
+    while (node) {
+        outList_t *temp = node;
+        node = node->next;
+        node_release(temp);
     }
+    head->next = NULL;
 }
 
 // Funkcja identycznościowa dla prostego automatu moora
@@ -106,42 +506,553 @@ void ID (uint64_t *output, uint64_t const *state,size_t m, size_t s) {
     memcpy(output, state, SIZEOF_64_UINT(m));
 }
 
-// Tworzy automat, callocując wszystkie bity i ustawiając całego structa
-moore_t * ma_create_full(size_t n, size_t m, size_t s, transition_function_t t,
-                         output_function_t y, uint64_t const *q) { // czy checemy zwolnić q czy programista się tym zajmie
-    if (!m || !s || !t || !y || !q) { // czemu dla n = 0 mamy wywalone?
-        errno = EINVAL;
-        return NULL;
+// Zwraca len bitów (0 < len <= 64) z src zaczynając od bitu bit, czytając co najwyżej dwa słowa
+static inline uint64_t get_bits(uint64_t const *src, size_t bit, size_t len) {
+    size_t w = bit / 64, off = bit % 64;
+    uint64_t x = src[w] >> off;
+    if (off + len > 64) x |= src[w + 1] << (64 - off);
+    return x & LOW_MASK(len);
+}
+
+// Kopiuje len bitów z src (od bitu sb) do dst (od bitu db), zmieniając tylko bity dst zaznaczone w wired
+static void copy_bits(uint64_t *dst, size_t db, uint64_t const *src, size_t sb, size_t len,
+                      uint64_t const *wired) {
+    while (len) {
+        size_t off = db % 64;
+        size_t take = 64 - off < len ? 64 - off : len;
+        uint64_t mask = (LOW_MASK(take) << off) & wired[db / 64];
+        uint64_t x = get_bits(src, sb, take) << off;
+        dst[db / 64] = (dst[db / 64] & ~mask) | (x & mask);
+        db += take;
+        sb += take;
+        len -= take;
     }
-    moore_t *ma = (moore_t*)malloc(sizeof(moore_t));
-    if (ma == NULL) {
-        errno = ENOMEM;
-        return NULL;
+}
+
+// Jak copy_bits, ale zmienia słowa dst atomowo, bo inne wątki mogą w tym samym czasie
+// zmieniać inne bity tych słów
+static void copy_bits_atomic(uint64_t *dst, size_t db, uint64_t const *src, size_t sb, size_t len,
+                             uint64_t const *wired) {
+    while (len) {
+        size_t off = db % 64;
+        size_t take = 64 - off < len ? 64 - off : len;
+        uint64_t mask = (LOW_MASK(take) << off) & wired[db / 64];
+        uint64_t x = get_bits(src, sb, take) << off;
+        _Atomic uint64_t *word = (_Atomic uint64_t*)&dst[db / 64];
+        // Nasze bity zmieniamy tylko my, więc różnicę można policzyć z dowolnego odczytu
+        uint64_t diff = (atomic_load_explicit(word, memory_order_relaxed) ^ x) & mask;
+        if (diff) atomic_fetch_xor_explicit(word, diff, memory_order_relaxed);
+        db += take;
+        sb += take;
+        len -= take;
     }
-    ma->input = (uint64_t*)calloc(CEIL64(n), sizeof(uint64_t));
-    ma->output = (uint64_t*)calloc(CEIL64(m), sizeof(uint64_t));
-    ma->state = (uint64_t*)calloc(CEIL64(s), sizeof(uint64_t));
-    ma->new_state = (uint64_t*)calloc(CEIL64(s), sizeof(uint64_t));
-    ma->head = create();
-    ma->origins = (origin_t*)calloc(n,sizeof(origin_t));
-    if (!ma->input || !ma->output || !ma->state || !ma->head || !ma->origins || !ma->new_state) {
+}
+
+// Ustawia bity [lo, hi) tablicy bits na value
+static void set_range(uint64_t *bits, size_t lo, size_t hi, bool value) {
+    while (lo < hi) {
+        size_t off = lo % 64;
+        size_t take = 64 - off < hi - lo ? 64 - off : hi - lo;
+        uint64_t mask = LOW_MASK(take) << off;
+        if (value) bits[lo / 64] |= mask;
+        else bits[lo / 64] &= ~mask;
+        lo += take;
+    }
+}
+
+// Liczy ustawione bity [lo, hi) tablicy bits
+static size_t count_range(uint64_t const *bits, size_t lo, size_t hi) {
+    size_t count = 0;
+    while (lo < hi) {
+        size_t off = lo % 64;
+        size_t take = 64 - off < hi - lo ? 64 - off : hi - lo;
+        count += __builtin_popcountll(bits[lo / 64] & (LOW_MASK(take) << off));
+        lo += take;
+    }
+    return count;
+}
+
+// Zwraca indeks pierwszego fragmentu planu, który kończy się za bitem bit
+static size_t plan_find(moore_t const *a, size_t bit) {
+    size_t lo = 0, hi = a->plan_len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a->plan[mid].dst_bit + a->plan[mid].len <= bit) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Zapewnia miejsce na extra nowych fragmentów planu
+static int plan_reserve(moore_t *a, size_t extra) {
+    if (a->plan_len + extra <= a->plan_cap) return 0;
+    size_t cap = a->plan_cap ? 2 * a->plan_cap : 4;
+    while (cap < a->plan_len + extra) cap *= 2;
+    run_t *plan = (run_t*)realloc(a->plan, cap * sizeof(run_t));
+    if (!plan) {
         errno = ENOMEM;
-        if (ma->input) free(ma->input);
-        if (ma->output) free(ma->output);
-        if (ma->state) free(ma->state);
-        if (ma->head) free(ma->head);
-        if (ma->origins) free(ma->origins);
-        if (ma->new_state) free(ma->new_state);
-        free(ma);
-        return NULL;
+        return -1;
+    }
+    a->plan = plan;
+    a->plan_cap = cap;
+    return 0;
+}
+
+// Wstawia fragment na pozycję i, przesuwając dalsze (miejsce musi być zarezerwowane)
+static void plan_insert(moore_t *a, size_t i, run_t run) {
+    if (i < a->plan_len) memmove(&a->plan[i + 1], &a->plan[i], (a->plan_len - i) * sizeof(run_t));
+    a->plan[i] = run;
+    a->plan_len++;
+}
+
+// Usuwa fragmenty [i, j) planu
+static void plan_erase(moore_t *a, size_t i, size_t j) {
+    // Plan, którego nigdy nie zaalokowano, jest pusty, i nie ma czego przesuwać
+    if (i == j) return;
+    memmove(&a->plan[i], &a->plan[j], (a->plan_len - j) * sizeof(run_t));
+    a->plan_len -= j - i;
+}
+
+// Wycina wejścia [lo, hi) z planu i zwraca pozycję, na której zaczynałby się fragment od lo.
+// Fragment obejmujący cały przedział z obu stron jest dzielony tylko gdy split, wpp. zostaje
+// w planie z dziurą, którą zasłania maska wired. Podział wymaga jednego zarezerwowanego miejsca.
+static size_t plan_cut(moore_t *a, size_t lo, size_t hi, bool split) {
+    size_t i = plan_find(a, lo);
+    if (i == a->plan_len || a->plan[i].dst_bit >= hi) return i;
+    run_t *r = &a->plan[i];
+    size_t end = r->dst_bit + r->len;
+    if (r->dst_bit < lo && end > hi) {
+        if (!split) return i + 1;
+        run_t right = {r->src, r->slot, r->gen, r->src_bit + (hi - r->dst_bit), hi, end - hi, r->seen};
+        r->len = lo - r->dst_bit;
+        plan_insert(a, i + 1, right);
+        return i + 1;
+    }
+    if (r->dst_bit < lo) {
+        r->len = lo - r->dst_bit;
+        i++;
+    }
+    size_t j = i;
+    while (j < a->plan_len && a->plan[j].dst_bit + a->plan[j].len <= hi) j++;
+    if (j < a->plan_len && a->plan[j].dst_bit < hi) {
+        size_t cut = hi - a->plan[j].dst_bit;
+        a->plan[j].dst_bit += cut;
+        a->plan[j].src_bit += cut;
+        a->plan[j].len -= cut;
+    }
+    plan_erase(a, i, j);
+    return i;
+}
+
+// Skleja fragment i z następnym, jeśli ciągną kolejne bity z tego samego źródła
+static bool plan_merge_next(moore_t *a, size_t i) {
+    if (i + 1 >= a->plan_len) return false;
+    run_t *l = &a->plan[i], *r = &a->plan[i + 1];
+    if (l->slot != r->slot || l->gen != r->gen || l->dst_bit + l->len != r->dst_bit || l->src_bit + l->len != r->src_bit)
+        return false;
+    l->len += r->len;
+    plan_erase(a, i + 1, i + 2);
+    return true;
+}
+
+// Usuwa z listy podłączeń src node'a do a, przez którego nie płynie już żaden bit, razem
+// z pustymi fragmentami planu a pochodzącymi z src. Wszystkie leżą w przedziale zapisanym w node'zie.
+static void drop_node(moore_t *a, moore_t *src, outList_t *node) {
+    size_t r = plan_find(a, node->lo), k = r;
+    for (; r < a->plan_len && a->plan[r].dst_bit < node->hi; r++) {
+        run_t *run = &a->plan[r];
+        if (run->slot != src->slot || !run_live(run)) a->plan[k++] = *run;
+    }
+    plan_erase(a, k, r);
+    fan_remove(src, node);
+    remove_node(node);
+}
+
+// Odejmuje od liczników node'ów źródeł bity wejść [lo, hi) automatu a, które są teraz podłączone.
+// Bity fragmentu zaznaczone w wired zawsze pochodzą z jego źródła, dziury nie są liczone.
+// Node'y, przez które nic już nie płynie, są od razu zwalniane.
+static void unwire_counts(moore_t *a, size_t lo, size_t hi) {
+    size_t r = plan_find(a, lo);
+    while (r < a->plan_len && a->plan[r].dst_bit < hi) {
+        run_t *run = &a->plan[r];
+        size_t l = run->dst_bit > lo ? run->dst_bit : lo;
+        size_t h = run->dst_bit + run->len < hi ? run->dst_bit + run->len : hi;
+        size_t count = run_live(run) ? count_range(a->wired, l, h) : 0;
+        outList_t *node = count ? find_node(run->src, a) : NULL;
+        if (node && (node->num -= count) == 0) {
+            // Fragmenty przed h są już policzone, a fragment z bitem h - 1 właśnie zniknął
+            drop_node(a, run->src, node);
+            r = plan_find(a, h);
+        }
+        else r++;
     }
+}
+
+// Usuwa z planu a fragmenty przecinające [lo, hi), których źródło zostało usunięte.
+// Ich wejścia stają się odłączone. Bez tych fragmentów suma wersji źródeł może przypadkiem
+// zgodzić się z in_sum, więc automat trzeba policzyć w najbliższym kroku.
+static void plan_sweep(moore_t *a, size_t lo, size_t hi) {
+    size_t r = plan_find(a, lo), k = r;
+    for (; r < a->plan_len && a->plan[r].dst_bit < hi; r++) {
+        run_t run = a->plan[r];
+        if (run_live(&run)) a->plan[k++] = run;
+        else set_range(a->wired, run.dst_bit, run.dst_bit + run.len, false);
+    }
+    if (k != r) a->input_dirty = true;
+    plan_erase(a, k, r);
+}
+
+// Przydziela a bufory na wartości wpychane przez źródła w trybie push. Odbiorcy bez nich (także po
+// nieudanej alokacji) źródła nic nie wpychają, sam doczytuje ich wyjścia przy zbieraniu wejść.
+static void stage_reserve(moore_t *a) {
+    if (a->staged) return;
+    size_t words = WORDS64(a->n);
+    uint64_t *buf = (uint64_t*)calloc(2 * words + WORDS64(words), sizeof(uint64_t));
+    if (!buf) return;
+    a->staged = buf;
+    a->staged_bits = buf + words;
+    a->staged_words = buf + 2 * words;
+}
+
+// Zaznacza bity [lo, lo + len) wejścia a jako wepchnięte do staged. Dla shared zapis jest atomowy.
+static void mark_staged(moore_t *a, size_t lo, size_t len, bool shared) {
+    while (len) {
+        size_t off = lo % 64, w = lo / 64;
+        size_t take = 64 - off < len ? 64 - off : len;
+        uint64_t mask = LOW_MASK(take) << off, word = 1ULL << (w % 64);
+        if (shared) {
+            atomic_fetch_or_explicit((_Atomic uint64_t*)&a->staged_bits[w], mask, memory_order_relaxed);
+            atomic_fetch_or_explicit((_Atomic uint64_t*)&a->staged_words[w / 64], word, memory_order_relaxed);
+        }
+        else {
+            a->staged_bits[w] |= mask;
+            a->staged_words[w / 64] |= word;
+        }
+        lo += take;
+        len -= take;
+    }
+}
+
+// Przepisuje na wejście a od bitu db te z bitów [sb, sb + len) wyjścia src, które leżą w słowach
+// zaznaczonych w mapie dirty. Dla stage zapisuje do staged zamiast do input. Dla shared zapis jest atomowy.
+static void copy_dirty(moore_t *a, size_t db, moore_t const *src, size_t sb, size_t len, bool stage, bool shared) {
+    uint64_t *dst = stage ? a->staged : a->input;
+    size_t last = (sb + len - 1) / 64;
+    for (size_t w = sb / 64; w <= last;) {
+        uint64_t bits = src->dirty[w / 64] >> (w % 64);
+        if (!bits) {
+            w = (w / 64 + 1) * 64;
+            continue;
+        }
+        w += __builtin_ctzll(bits);
+        if (w > last) break;
+        size_t lo = w * 64 > sb ? w * 64 : sb;
+        size_t hi = (w + 1) * 64 < sb + len ? (w + 1) * 64 : sb + len;
+        if (shared) copy_bits_atomic(dst, db + (lo - sb), src->output, lo, hi - lo, a->wired);
+        else copy_bits(dst, db + (lo - sb), src->output, lo, hi - lo, a->wired);
+        if (stage) mark_staged(a, db + (lo - sb), hi - lo, shared);
+        w++;
+    }
+}
+
+// Przepisuje len bitów wyjścia src od bitu sb na wejście a od bitu db. Jeśli wejście ma już wersję
+// *seen, a wyjście zmieniło się od niej raz, kopiuje tylko słowa zaznaczone w mapie dirty źródła.
+static void pull_run(moore_t *a, size_t db, moore_t const *src, size_t sb, size_t len,
+                     unsigned long *seen) {
+    unsigned long version = src->out_version;
+    if (!a->input_dirty && *seen == version) return;
+    if (a->input_dirty || *seen + 1 != version)
+        copy_bits(a->input, db, src->output, sb, len, a->wired);
+    else copy_dirty(a, db, src, sb, len, false, false);
+    *seen = version;
+}
+
+// Przepisuje do wejścia wartości wepchnięte przez źródła od ostatniego zbierania wejść. Do tego
+// czasu input trzyma ostatnie zebrane wartości, więc wejście odłączone albo od usuniętego źródła
+// zachowuje je tak samo jak w trybie pull: takie bity pomija maska wired.
+static void commit_staged(moore_t *a) {
+    if (!a->staged) return;
+    size_t words = WORDS64(WORDS64(a->n)), w = 0;
+    while (w < words && !a->staged_words[w]) w++;
+    if (w == words) return;
+    for (size_t r = 0; r < a->plan_len; r++) {
+        run_t const *run = &a->plan[r];
+        if (!run_live(run)) set_range(a->wired, run->dst_bit, run->dst_bit + run->len, false);
+    }
+    for (; w < words; w++) {
+        uint64_t bits = a->staged_words[w];
+        a->staged_words[w] = 0;
+        while (bits) {
+            size_t i = 64 * w + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            uint64_t mask = a->staged_bits[i] & a->wired[i];
+            a->input[i] = (a->input[i] & ~mask) | (a->staged[i] & mask);
+            a->staged_bits[i] = 0;
+        }
+    }
+}
+
+// Przepisuje wyjścia podłączonych automatów na wejście a, po drodze wyrzucając z planu
+// fragmenty usuniętych automatów i zapamiętując wersje wyjść źródeł
+static void gather_inputs(moore_t *a) {
+    commit_staged(a);
+    size_t k = 0;
+    unsigned long sum = 0;
+    for (size_t r = 0; r < a->plan_len; r++) {
+        run_t *run = &a->plan[r];
+        if (!run_live(run)) {
+            set_range(a->wired, run->dst_bit, run->dst_bit + run->len, false);
+            continue;
+        }
+        pull_run(a, run->dst_bit, run->src, run->src_bit, run->len, &run->seen);
+        sum += run->src->out_version;
+        if (k != r) a->plan[k] = *run;
+        k++;
+    }
+    a->plan_len = k;
+    a->in_sum = sum;
+}
+
+// Czy automat stoi w punkcie stałym: ostatnie przejście nie zmieniło stanu, a od tamtej pory nie
+// zmieniło się wejście ani żadne z wyjść, które czyta. Wersje tylko rosną, więc wystarczy ich suma.
+static bool quiescent(moore_t const *a) {
+    if (!a->settled || a->input_dirty || (a->flags & MA_TIME_DEPENDENT)) return false;
+    unsigned long sum = 0;
+    for (size_t r = 0; r < a->plan_len; r++) {
+        run_t const *run = &a->plan[r];
+        // Fragment usuniętego źródła trzeba wyrzucić przy zbieraniu wejść
+        if (!run_live(run)) return false;
+        sum += run->src->out_version;
+    }
+    return sum == a->in_sum;
+}
+
+// Czy ktoś czyta wyjście automatu, tzn. czy ma jakiekolwiek podłączenie wychodzące
+static inline bool has_consumers(moore_t const *a) {
+    return a->head->next != NULL;
+}
+
+// Wpisuje słowa wyjścia a zmienione przy ostatnim przeliczeniu do staged odbiorców, których
+// fragmenty planu z a były aktualne, skąd trafią na wejście przy zbieraniu wejść bez czytania a.
+// Pozostałe fragmenty, także wszystkie fragmenty odbiorców bez buforów staged, odbiorca sam
+// doczyta przy zbieraniu wejść.
+// Równolegle wyjścia liczy kilka wątków, więc wtedy zapisujemy atomowo.
+static void push_output(moore_t *a) {
+    bool shared = pool != NULL;
+    for (outList_t *node = a->head->next; node; node = node->next) {
+        moore_t *c = node->ma;
+        if (!c->staged) continue;
+        for (size_t r = plan_find(c, node->lo); r < c->plan_len && c->plan[r].dst_bit < node->hi; r++) {
+            run_t *run = &c->plan[r];
+            if (run->slot != a->slot || !run_live(run) || run->seen + 1 != a->out_version) continue;
+            copy_dirty(c, run->dst_bit, a, run->src_bit, run->len, true, shared);
+            run->seen = a->out_version;
+        }
+    }
+}
+
+// Rodzaje węzłów netlisty poza bramkami MA_GATE_*
+#define OP_INPUT 5
+#define OP_STATE 6
+#define OP_CONST 7
+
+// Węzeł netlisty albo instrukcja programu: wynik op na węzłach a, b, c. Dla OP_INPUT i OP_STATE
+// a to numer bitu, dla OP_CONST wartość 0 albo 1.
+struct gate {
+    uint8_t op;
+    uint32_t a, b, c;
+};
+
+// Część programu skompilowana do kodu maszynowego: zapisuje wynik do dst, licząc w regs
+typedef void (*jit_function_t)(uint64_t *dst, uint64_t const *input, uint64_t const *state, uint64_t *regs);
+
+// Skompilowana netlista, wspólna dla wszystkich automatów z tej samej jej wersji o tym samym
+// układzie. Instrukcja i zapisuje wynik w regs[i], code[0..step_len) liczy nowy stan,
+// a code[step_len..step_len + out_len) wyjście. Bit j nowego stanu to rejestr step_res[j],
+// bit j wyjścia to rejestr out_res[j] części wyjściowej.
+struct program {
+    size_t refs; // automaty i netlista, która trzyma program do ponownego użycia
+    size_t s, m; // bity logiczne stanu i wyjścia
+    size_t step_len, out_len, regs;
+    gate_t *code;
+    uint32_t *step_res, *out_res;
+    jit_function_t jit[2]; // kod przejścia i wyjścia albo NULL, wtedy liczy interpreter
+    void *jit_code; // strony z kodem maszynowym
+    size_t jit_size;
+    bool jit_tried; // kompilację do kodu maszynowego próbujemy tylko raz
+};
+
+// Wykonuje len instrukcji na słowach: w automacie bit-sliced każdy rejestr niesie 64 scenariusze,
+// w zwykłym wartość bitu powieloną na całe słowo, czyli jedną bramkę jednego scenariusza. Wynik zapisuje do count bitów dst.
+static void program_run(gate_t const *code, size_t len, uint32_t const *res, size_t count, uint64_t *regs,
+                        uint64_t *dst, uint64_t const *input, uint64_t const *state, bool sliced) {
+    for (size_t i = 0; i < len; i++) {
+        gate_t const *g = &code[i];
+        uint64_t v;
+        switch (g->op) {
+            case OP_INPUT:
+                v = sliced ? input[g->a] : 0 - (input[g->a / 64] >> (g->a % 64) & 1);
+                break;
+            case OP_STATE:
+                v = sliced ? state[g->a] : 0 - (state[g->a / 64] >> (g->a % 64) & 1);
+                break;
+            case OP_CONST: v = g->a ? UINT64_MAX : 0; break;
+            case MA_GATE_AND: v = regs[g->a] & regs[g->b]; break;
+            case MA_GATE_OR: v = regs[g->a] | regs[g->b]; break;
+            case MA_GATE_XOR: v = regs[g->a] ^ regs[g->b]; break;
+            case MA_GATE_NOT: v = ~regs[g->a]; break;
+            default: v = (regs[g->a] & regs[g->b]) | (~regs[g->a] & regs[g->c]); break;
+        }
+        regs[i] = v;
+    }
+    if (sliced) {
+        for (size_t j = 0; j < count; j++) dst[j] = regs[res[j]];
+        return;
+    }
+    memset(dst, 0, WORDS64(count) * sizeof(uint64_t));
+    for (size_t j = 0; j < count; j++) dst[j / 64] |= (regs[res[j]] & 1) << (j % 64);
+}
+
+// Liczy programem automatu a nowy stan (out == false) albo wyjście, kodem maszynowym jeśli go używa
+static inline void program_exec(moore_t const *a, bool out, uint64_t *dst, uint64_t const *input,
+                                uint64_t const *state) {
+    program_t *p = a->program;
+    if (a->native) p->jit[out](dst, input, state, a->regs);
+    else if (out) program_run(p->code + p->step_len, p->out_len, p->out_res, p->m, a->regs, dst, input, state, a->sliced);
+    else program_run(p->code, p->step_len, p->step_res, p->s, a->regs, dst, input, state, a->sliced);
+}
+
+// Liczy wyjście automatu do dst: z tablicy, programem netlisty albo funkcją użytkownika
+static inline void compute_output(moore_t const *a, uint64_t *dst) {
+    if (a->table) dst[0] = a->table->out[a->state[0] & LOW_MASK(a->s)];
+    else if (a->program) program_exec(a, true, dst, NULL, a->state);
+    else a->output_function(dst, a->state, USER_WIDTH(a, a->m), USER_WIDTH(a, a->s));
+}
+
+// Przelicza wyjście, jeśli stan zmienił się od ostatniego liczenia. Wyjście czytane przez inne
+// automaty liczymy obok i przepisujemy tylko zmienione słowa, zaznaczając je w mapie dirty.
+static inline void refresh_output(moore_t *a) {
+    if (a->output_valid) return;
+    a->output_valid = true;
+    if (!has_consumers(a)) {
+        compute_output(a, a->output);
+        a->out_version += 2;
+        return;
+    }
+    size_t words = WORDS64(a->m);
+    // Funkcja wyjścia dostaje poprzednie wyjście, tak jak gdyby liczyła w miejscu
+    memcpy(a->scratch, a->output, words * sizeof(uint64_t));
+    compute_output(a, a->scratch);
+    memset(a->dirty, 0, WORDS64(words) * sizeof(uint64_t));
+    for (size_t w = 0; w < words; w++) {
+        if (a->scratch[w] != a->output[w]) {
+            a->output[w] = a->scratch[w];
+            a->dirty[w / 64] |= 1ULL << (w % 64);
+        }
+    }
+    a->out_version++;
+    if (a->push) push_output(a);
+}
+
+// Rezerwuje w bloku o rozmiarze *total miejsce na count elementów rozmiaru size, wyrównane do linii.
+// Zwraca przesunięcie początku, a przy przepełnieniu ustawia *total na SIZE_MAX.
+static size_t layout_add(size_t *total, size_t count, size_t size) {
+    if (*total == SIZE_MAX) return 0;
+    if (size && count > (SIZE_MAX - CACHE_LINE) / size) {
+        *total = SIZE_MAX;
+        return 0;
+    }
+    size_t bytes = (count * size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    if (*total > SIZE_MAX - 2 * CACHE_LINE - bytes) {
+        *total = SIZE_MAX;
+        return 0;
+    }
+    size_t offset = *total;
+    *total += bytes;
+    return offset;
+}
+
+// Liczy rozmieszczenie automatu o podanych rozmiarach. Struktura, atrapa listy i wszystkie bity
+// leżą w jednym bloku pamięci, każda część od początku linii pamięci podręcznej.
+// Dla slabbed wejście i stany leżą poza blokiem, w tablicach rodziny.
+static layout_t ma_layout(size_t n, size_t m, size_t s, bool slabbed) {
+    layout_t l;
+    l.total = 0;
+    layout_add(&l.total, 1, sizeof(moore_t));
+    l.head = layout_add(&l.total, 1, sizeof(outList_t));
+    l.input = layout_add(&l.total, slabbed ? 0 : WORDS64(n), sizeof(uint64_t));
+    l.wired = layout_add(&l.total, WORDS64(n), sizeof(uint64_t));
+    l.output = layout_add(&l.total, WORDS64(m), sizeof(uint64_t));
+    l.state = layout_add(&l.total, slabbed ? 0 : WORDS64(s), sizeof(uint64_t));
+    l.new_state = layout_add(&l.total, slabbed ? 0 : WORDS64(s), sizeof(uint64_t));
+    l.scratch = layout_add(&l.total, WORDS64(m), sizeof(uint64_t));
+    l.dirty = layout_add(&l.total, WORDS64(WORDS64(m)), sizeof(uint64_t));
+    return l;
+}
+
+// Układa automat w wyzerowanej, wyrównanej do linii pamięci base. Jeśli slabs nie jest NULL,
+// wskazuje wejście, stan i nowy stan leżące poza blokiem. NULL dla nieudanej alokacji.
+static moore_t * ma_place(char *base, layout_t const *l, size_t n, size_t m, size_t s,
+                          transition_function_t t, output_function_t y, uint64_t const *q,
+                          uint64_t *const *slabs) {
+    moore_t *ma = (moore_t*)base;
+    if (handle_acquire(ma)) return NULL;
+    ma->head = (outList_t*)(base + l->head);
+    ma->input = slabs ? slabs[0] : (uint64_t*)(base + l->input);
+    ma->wired = (uint64_t*)(base + l->wired);
+    ma->output = (uint64_t*)(base + l->output);
+    ma->state = slabs ? slabs[1] : (uint64_t*)(base + l->state);
+    ma->new_state = slabs ? slabs[2] : (uint64_t*)(base + l->new_state);
+    ma->scratch = (uint64_t*)(base + l->scratch);
+    ma->dirty = (uint64_t*)(base + l->dirty);
     ma->n = n;
     ma->m = m;
     ma->s = s;
     ma->transition = t;
     ma->output_function = y;
     memcpy(ma->state, q, SIZEOF_64_UINT(s));
-    y(ma->output, ma->state, ma->m, ma->s);
+    return ma;
+}
+
+// Liczy pierwsze wyjście ułożonego automatu
+static void init_output(moore_t *ma) {
+    compute_output(ma, ma->output);
+    ma->output_valid = true;
+}
+
+// Układa automat w osobnym bloku pamięci, bez liczenia pierwszego wyjścia
+static moore_t * create_block(size_t n, size_t m, size_t s, transition_function_t t,
+                              output_function_t y, uint64_t const *q) {
+    layout_t l = ma_layout(n, m, s, false);
+    if (l.total == SIZE_MAX) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    void *block = calloc(1, l.total + CACHE_LINE);
+    if (!block) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    char *base = (char*)(((uintptr_t)block + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1));
+    moore_t *ma = ma_place(base, &l, n, m, s, t, y, q, NULL);
+    if (!ma) {
+        free(block);
+        return NULL;
+    }
+    ma->block = block;
+    return ma;
+}
+
+// Tworzy automat w osobnym bloku pamięci
+moore_t * ma_create_full(size_t n, size_t m, size_t s, transition_function_t t,
+                         output_function_t y, uint64_t const *q) { // czy checemy zwolnić q czy programista się tym zajmie
+    if (!m || !s || !t || !y || !q) { // czemu dla n = 0 mamy wywalone?
+        errno = EINVAL;
+        return NULL;
+    }
+    moore_t *ma = create_block(n, m, s, t, y, q);
+    if (!ma) return NULL;
+    init_output(ma);
     return ma;
 }
 
@@ -161,99 +1072,209 @@ moore_t * ma_create_simple(size_t n,size_t m, transition_function_t t) {\
     return ma;
 }
 
-// Zwalnia pamięc całego automatu
-void ma_delete(moore_t *a) {
-    if (!a) {
+static void network_remove(moore_t *a);
+static void program_release(program_t *p);
+
+// Tworzy automat bit-sliced: każdy z n bitów wejścia, m bitów wyjścia i s bitów stanu jest słowem,
+// którego bit j należy do scenariusza j. Funkcje t i y dostają n, m, s słów i liczą 64 scenariusze
+// naraz, więc powinny używać tylko operacji bitowych na całych słowach. ma_connect i ma_disconnect
+// przyjmują dla takich automatów numery słów.
+moore_t * ma_create_sliced(size_t n, size_t m, size_t s, transition_function_t t,
+                           output_function_t y, uint64_t const *q) {
+    if (!m || !s || !t || !y || !q) {
         errno = EINVAL;
-        return; // nic nie ma w zadaniu o errno dla ma_delete
-    }
-    outList_t *node = a->head->next;
-    while (node) {
-        if (node->num){
-            moore_t *aut = node->ma;
-            for (size_t i = 0; i < aut->n; i++) {
-                if (aut->origins[i].ma == a) {
-                    aut->origins[i].ma = NULL;
-                    aut->origins[i].dest = NULL;
-                    aut->origins[i].out = 0;
-                }
-            }
-        }
-        node = node->next;
+        return NULL;
     }
-    for (size_t i = 0 ; i < a->n; i++) {
-        if (a->origins[i].ma) {
-            a->origins[i].dest->num--;
-        }
+    if (n > SIZE_MAX / 64 || m > SIZE_MAX / 64 || s > SIZE_MAX / 64) {
+        errno = ENOMEM;
+        return NULL;
     }
-    free(a->input);
-    free(a->output);
-    free(a->state);
-    free(a->origins);
-    free(a->new_state);
-    clear_list(a->head);
-    free(a);
+    moore_t *ma = create_block(64 * n, 64 * m, 64 * s, t, y, q);
+    if (!ma) return NULL;
+    ma->sliced = true;
+    init_output(ma);
+    return ma;
 }
 
-int ma_connect(moore_t *a_in, size_t in, moore_t *a_out, size_t out, size_t num) {
-    if (!a_in || !a_out || !num) {
-        errno = EINVAL;
-        return -1;
-    }
-    if (in + num > a_in->n || out + num > a_out->m) {
+// Tworzy automat tablicowy dla n + s <= 16 i m <= 64: nowy stan to next_table[input | state << n],
+// a wyjście to out_table[state], bez wywołań funkcji użytkownika. Automaty o tych samych
+// tablicach dzielą jedną ich kopię.
+moore_t * ma_create_table(size_t n, size_t m, size_t s, uint16_t const *next_table,
+                          uint64_t const *out_table, uint64_t const *q) {
+    if (!m || !s || m > 64 || n > 16 || s > 16 || n + s > 16 || !next_table || !out_table || !q) {
         errno = EINVAL;
-        return -1;
-    }
-    outList_t *node = add_node(a_out->head, a_in);
-    if (!node) {
-        errno = ENOMEM;
-        return -1;
+        return NULL;
     }
-    for (size_t i = 0; i < num; i++) {
-        if (a_in->origins[in + i].ma != a_out) {
-            node->num++;
-            if (a_in->origins[in + i].ma) a_in->origins[in + i].dest->num--;
-        }
-        a_in->origins[in + i].dest = node;
-        a_in->origins[in + i].ma = a_out;
-        a_in->origins[in + i].out = out + i;
+    table_t *t = table_acquire(n, m, s, next_table, out_table);
+    if (!t) return NULL;
+    moore_t *ma = create_block(n, m, s, NULL, NULL, q);
+    if (!ma) {
+        table_release(t);
+        return NULL;
     }
-    return 0;
+    ma->table = t;
+    ma->state[0] &= LOW_MASK(s);
+    init_output(ma);
+    return ma;
 }
 
-int ma_disconnect(moore_t *a_in, size_t in, size_t num) {
-    if (!a_in || !num || in + num > a_in->n) {
-        errno = EINVAL;
-        return -1;
-    }
-    for (size_t i = 0; i < num; i++) {
-        if (a_in->origins[in + i].ma) {
-            a_in->origins[in + i].dest->num--;
-            a_in->origins[in + i].ma = NULL;
-            a_in->origins[in + i].dest = NULL;
-            a_in->origins[in + i].out = 0;
+// Transponuje macierz bitów 64x64: bit j słowa i zamienia się z bitem i słowa j
+static void transpose64(uint64_t a[64]) {
+    uint64_t mask = 0x00000000FFFFFFFFULL;
+    for (size_t j = 32; j; j >>= 1, mask ^= mask << j) {
+        for (size_t k = 0; k < 64; k = (k + j + 1) & ~j) {
+            uint64_t t = ((a[k] >> j) ^ a[k + j]) & mask;
+            a[k + j] ^= t;
+            a[k] ^= t << j;
         }
     }
-    return 0;
 }
 
-int ma_set_input(moore_t *a, uint64_t const *input) { // Bez połączeń
-    if (!a || !input) {
+// Składa 64 wektory bits bitów, leżące kolejno w lanes po WORDS64(bits) słów, w bits słów sliced:
+// bit j słowa i to bit i scenariusza j
+int ma_slice_pack(uint64_t *sliced, uint64_t const *lanes, size_t bits) {
+    if (!sliced || !lanes) {
         errno = EINVAL;
         return -1;
     }
-    memcpy(a->input, input, SIZEOF_64_UINT(a->n));
+    size_t words = WORDS64(bits);
+    uint64_t block[64];
+    for (size_t w = 0; w < words; w++) {
+        for (size_t j = 0; j < 64; j++) block[j] = lanes[j * words + w];
+        transpose64(block);
+        size_t take = bits - 64 * w < 64 ? bits - 64 * w : 64;
+        memcpy(&sliced[64 * w], block, take * sizeof(uint64_t));
+    }
     return 0;
 }
 
-int ma_set_state(moore_t *a, uint64_t const *state) {
-    if (!a || !state) {
+// Odwrotność ma_slice_pack: rozkłada bits słów sliced na 64 wektory w lanes
+int ma_slice_unpack(uint64_t *lanes, uint64_t const *sliced, size_t bits) {
+    if (!sliced || !lanes) {
         errno = EINVAL;
         return -1;
     }
-    memcpy(a->state, state, SIZEOF_64_UINT(a->s));
-    output_function_t output_function = a->output_function;
-    output_function(a->output,a->state,a->m,a->s);
+    size_t words = WORDS64(bits);
+    uint64_t block[64];
+    for (size_t w = 0; w < words; w++) {
+        size_t take = bits - 64 * w < 64 ? bits - 64 * w : 64;
+        memset(block, 0, sizeof(block));
+        memcpy(block, &sliced[64 * w], take * sizeof(uint64_t));
+        transpose64(block);
+        for (size_t j = 0; j < 64; j++) lanes[j * words + w] = block[j];
+    }
+    return 0;
+}
+
+// Zwalnia pamięc całego automatu
+void ma_delete(moore_t *a) {
+    if (!a) {
+        errno = EINVAL;
+        return; // nic nie ma w zadaniu o errno dla ma_delete
+    }
+    wiring_epoch++;
+    // Odbiorców nie ruszamy: ich fragmenty wskazujące a przestają być ważne razem z jego
+    // generacją i znikną przy najbliższym zbieraniu wejść albo zmianie połączeń
+    unwire_counts(a, 0, a->n);
+    handle_release(a);
+    free(a->plan);
+    free(a->fan);
+    clear_list(a->head);
+    if (!handles.live) node_pool_trim();
+    if (a->table) table_release(a->table);
+    program_release(a->program);
+    free(a->regs);
+    free(a->staged);
+    // Blok automatu z sieci wraca do niej, network_remove zapisuje w nim nagłówek
+    if (a->family) {
+        a->family->members[a->family_index] = NULL;
+        a->family->live--;
+    }
+    if (a->net) network_remove(a);
+    else free(a->block);
+}
+
+int ma_connect(moore_t *a_in, size_t in, moore_t *a_out, size_t out, size_t num) {
+    if (!a_in || !a_out || !num) {
+        errno = EINVAL;
+        return -1;
+    }
+    // Automaty bit-sliced łączymy tylko ze sobą, całymi słowami scenariuszy
+    size_t lanes = a_in->sliced ? 64 : 1;
+    if (a_in->sliced != a_out->sliced || in + num > a_in->n / lanes || out + num > a_out->m / lanes) {
+        errno = EINVAL;
+        return -1;
+    }
+    in *= lanes;
+    out *= lanes;
+    num *= lanes;
+    // Podział istniejącego fragmentu i wstawienie nowego potrzebują co najwyżej dwóch miejsc
+    if (plan_reserve(a_in, 2)) return -1;
+    outList_t *node = add_node(a_out, a_in);
+    if (!node) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (in < node->lo) node->lo = in;
+    if (in + num > node->hi) node->hi = in + num;
+    plan_sweep(a_in, in, in + num);
+    // Najpierw doliczamy nowe bity, żeby node nie zniknął przy odliczaniu nadpisywanych bitów z a_out
+    node->num += num;
+    unwire_counts(a_in, in, in + num);
+    size_t i = plan_cut(a_in, in, in + num, true);
+    run_t run = {a_out, a_out->slot, handles.slots[a_out->slot].gen, out, in, num, 0};
+    plan_insert(a_in, i, run);
+    plan_merge_next(a_in, i);
+    if (i > 0) plan_merge_next(a_in, i - 1);
+    set_range(a_in->wired, in, in + num, true);
+    if (a_out->push) stage_reserve(a_in);
+    a_in->input_dirty = true;
+    wiring_epoch++;
+    return 0;
+}
+
+int ma_disconnect(moore_t *a_in, size_t in, size_t num) {
+    if (!a_in || !num || in + num > USER_WIDTH(a_in, a_in->n)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (a_in->sliced) {
+        in *= 64;
+        num *= 64;
+    }
+    plan_sweep(a_in, in, in + num);
+    unwire_counts(a_in, in, in + num);
+    // Bez dzielenia fragmentów, żeby rozłączanie nigdy nie alokowało pamięci
+    plan_cut(a_in, in, in + num, false);
+    set_range(a_in->wired, in, in + num, false);
+    a_in->input_dirty = true;
+    wiring_epoch++;
+    return 0;
+}
+
+int ma_set_input(moore_t *a, uint64_t const *input) { // Bez połączeń
+    if (!a || !input) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (memcmp(a->input, input, SIZEOF_64_UINT(a->n))) {
+        memcpy(a->input, input, SIZEOF_64_UINT(a->n));
+        a->input_dirty = true;
+    }
+    return 0;
+}
+
+int ma_set_state(moore_t *a, uint64_t const *state) {
+    if (!a || !state) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (memcmp(a->state, state, SIZEOF_64_UINT(a->s))) {
+        memcpy(a->state, state, SIZEOF_64_UINT(a->s));
+        a->output_valid = false;
+        a->settled = false;
+    }
+    refresh_output(a);
     return 0;
 }
 
@@ -262,38 +1283,1311 @@ uint64_t const * ma_get_output(moore_t const *a) {
         errno = EINVAL;
         return NULL;
     }
-    output_function_t output_function = a->output_function;
-    output_function(a->output,a->state,a->m,a->s);
+    // Wyjście jest liczone przy każdej zmianie stanu, więc zwykle nie ma czego przeliczać
+    refresh_output((moore_t*)a);
     return a->output;
 }
 
-int ma_step(moore_t *at[], size_t num) {
+// Liczy nowy stan a z zebranych już wejść. Bufory stanu zamieniamy wskaźnikami zamiast kopiować.
+// Wyjście, którego nikt nie czyta, można policzyć od razu.
+// Członek rodziny liczony osobno woła funkcję wsadową dla jednego automatu i kopiuje stan, żeby
+// nie wypaść ze wspólnych tablic rodziny.
+static inline void advance(moore_t *a) {
+    if (a->family) a->family->batch(a->new_state, a->input, a->state, a->n, a->s, 1);
+    else if (a->table) {
+        size_t in = a->n ? (size_t)(a->input[0] & LOW_MASK(a->n)) : 0;
+        a->new_state[0] = a->table->next[in | (size_t)(a->state[0] & LOW_MASK(a->s)) << a->n];
+    }
+    else if (a->program) program_exec(a, false, a->new_state, a->input, a->state);
+    else a->transition(a->new_state, a->input, a->state, USER_WIDTH(a, a->n), USER_WIDTH(a, a->s));
+    a->input_dirty = false;
+    a->settled = true;
+    if (memcmp(a->new_state, a->state, SIZEOF_64_UINT(a->s))) {
+        if (a->family) memcpy(a->state, a->new_state, SIZEOF_64_UINT(a->s));
+        else {
+            uint64_t *old = a->state;
+            a->state = a->new_state;
+            a->new_state = old;
+        }
+        a->output_valid = false;
+        a->settled = false;
+    }
+    if (!has_consumers(a)) refresh_output(a);
+}
+
+// Faza pierwsza kroku dla wszystkich żywych członków rodziny, jednym wywołaniem funkcji wsadowej.
+// Tryb zdarzeniowy nie pomija tu nikogo, bo i tak liczymy całą rodzinę naraz.
+static void family_transition(family_t *f) {
+    size_t ws = WORDS64(f->s);
+    for (size_t j = 0; j < f->k; j++)
+        if (f->members[j]) gather_inputs(f->members[j]);
+    f->batch(f->new_state, f->input, f->state, f->n, f->s, f->k);
+    uint64_t *old = f->state;
+    f->state = f->new_state;
+    f->new_state = old;
+    for (size_t j = 0; j < f->k; j++) {
+        moore_t *a = f->members[j];
+        if (!a) continue;
+        a->state = f->state + j * ws;
+        a->new_state = f->new_state + j * ws;
+        a->input_dirty = false;
+        a->settled = !memcmp(a->state, a->new_state, ws * sizeof(uint64_t));
+        if (!a->settled) a->output_valid = false;
+        if (!has_consumers(a)) refresh_output(a);
+    }
+}
+
+// Zbiera wejścia automatu i liczy jego nowy stan. W trybie zdarzeniowym pomija automat w punkcie stałym.
+static inline void step_one(moore_t *a) {
+    if (event_driven && quiescent(a)) return;
+    gather_inputs(a);
+    advance(a);
+}
+
+// Faza pierwsza kroku dla automatów at[lo..hi): zbiera wejścia i liczy nowe stany
+static void transition_phase(moore_t *at[], size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; i++) step_one(at[i]);
+}
+
+// Faza pierwsza kroku dla członków lo..hi grupy, wejścia zbiera według planu grupy
+static void group_transition(ma_group_t *g, size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; i++) {
+        moore_t *a = g->at[i];
+        unsigned long sum = 0;
+        for (size_t r = g->first[i]; r < g->first[i + 1]; r++) sum += g->runs[r].src->out_version;
+        if (event_driven && a->settled && !a->input_dirty && !(a->flags & MA_TIME_DEPENDENT) &&
+            sum == a->in_sum)
+            continue;
+        commit_staged(a);
+        for (size_t r = g->first[i]; r < g->first[i + 1]; r++) {
+            grun_t *run = &g->runs[r];
+            pull_run(a, run->dst_bit, run->src, run->src_bit, run->len, &run->seen);
+        }
+        a->in_sum = sum;
+        advance(a);
+    }
+}
+
+// Faza druga kroku dla automatów at[lo..hi): liczy wyjścia czytane przez inne automaty
+static void output_phase(moore_t *at[], size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; i++) {
+        moore_t *a = at[i];
+        if (has_consumers(a)) refresh_output(a);
+    }
+}
+
+#define PACK_RANGE(lo, hi) ((uint64_t)(lo) << 32 | (uint64_t)(hi))
+
+// Zabiera z dołu własnej kolejki kawałek pracy, tym mniejszy im mniej jej zostało
+static bool deque_pop(deque_t *d, size_t *lo, size_t *hi) {
+    uint64_t old = atomic_load(&d->range);
+    while (true) {
+        size_t l = old >> 32, h = old & UINT32_MAX;
+        if (l >= h) return false;
+        size_t take = (h - l) / 4 ? (h - l) / 4 : 1;
+        if (atomic_compare_exchange_weak(&d->range, &old, PACK_RANGE(l + take, h))) {
+            *lo = l;
+            *hi = l + take;
+            return true;
+        }
+    }
+}
+
+// Kradnie górną połowę cudzej kolejki
+static bool deque_steal(deque_t *d, size_t *lo, size_t *hi) {
+    uint64_t old = atomic_load(&d->range);
+    while (true) {
+        size_t l = old >> 32, h = old & UINT32_MAX;
+        if (l >= h) return false;
+        size_t mid = l + (h - l) / 2;
+        if (atomic_compare_exchange_weak(&d->range, &old, PACK_RANGE(l, mid))) {
+            *lo = mid;
+            *hi = h;
+            return true;
+        }
+    }
+}
+
+// Wykonuje fazę phase (0 – przejścia, 1 – wyjścia) dla automatów job->at[lo..hi)
+static void run_phase(job_t const *job, int phase, size_t lo, size_t hi) {
+    if (phase == 0 && job->group) group_transition(job->group, lo, hi);
+    else if (phase == 0) transition_phase(job->at, lo, hi);
+    else output_phase(job->at, lo, hi);
+}
+
+// Wątek id wykonuje swoją część fazy, a przed barierą przygotowuje swoją kolejkę na następną fazę
+static void pool_phase(job_t const *job, size_t id, int phase) {
+    size_t lo = job->num * id / pool->size, hi = job->num * (id + 1) / pool->size;
+    if (job->schedule != MA_SCHED_STEAL) {
+        run_phase(job, phase, lo, hi);
+        return;
+    }
+    deque_t *dq = pool->deques[phase];
+    while (true) {
+        size_t l, h;
+        if (deque_pop(&dq[id], &l, &h)) {
+            run_phase(job, phase, l, h);
+            continue;
+        }
+        bool stolen = false;
+        for (size_t k = 1; k < pool->size && !stolen; k++) {
+            if (deque_steal(&dq[(id + k) % pool->size], &l, &h)) {
+                pool->steals[id]++;
+                // Skradziony przedział trafia do własnej kolejki, żeby inni mogli go dalej dzielić
+                atomic_store(&dq[id].range, PACK_RANGE(l, h));
+                stolen = true;
+            }
+        }
+        if (!stolen) break;
+    }
+    // Nikt nie czyta kolejek drugiej fazy, dopóki wszyscy nie przejdą przez barierę
+    atomic_store(&pool->deques[1 - phase][id].range, PACK_RANGE(lo, hi));
+}
+
+// Wątek o numerze id wykonuje swoją część kroków zlecenia. Callback woła tylko
+// wątek wywołujący, reszta czeka na niego na barierze.
+static void pool_work(job_t const *job, size_t id) {
+    for (size_t k = 0; k < job->steps; k++) {
+        if (job->callback) {
+            if (id == 0) job->callback(job->at, job->num, k, job->arg);
+            pthread_barrier_wait(&pool->barrier);
+        }
+        pool_phase(job, id, 0);
+        pthread_barrier_wait(&pool->barrier);
+        pool_phase(job, id, 1);
+        pthread_barrier_wait(&pool->barrier);
+    }
+}
+
+// Pętla wątku z puli: czeka na kolejne zlecenie albo na zamknięcie puli
+static void * pool_worker(void *arg) {
+    size_t id = (size_t)arg;
+    unsigned long seen = 0;
+    while (true) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->round == seen && !pool->stop) pthread_cond_wait(&pool->wake, &pool->lock);
+        bool stop = pool->stop;
+        seen = pool->round;
+        job_t job = pool->job;
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) return NULL;
+        pool_work(&job, id);
+    }
+}
+
+// Zwalnia tablice puli i samą pulę, bez ruszania wątków i obiektów synchronizacji
+static void pool_free(void) {
+    free(pool->threads);
+    free(pool->deques[0]);
+    free(pool->deques[1]);
+    free(pool->steals);
+    free(pool);
+    pool = NULL;
+}
+
+// Zatrzymuje pierwsze k wątków puli i zwalnia ją
+static void pool_destroy(size_t k) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (size_t i = 0; i < k; i++) pthread_join(pool->threads[i], NULL);
+    pthread_barrier_destroy(&pool->barrier);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    pool_free();
+}
+
+// Ustawia liczbę wątków wykonujących ma_step, dla threads <= 1 krok jest sekwencyjny.
+// Wątki pomocnicze żyją do kolejnego wywołania, wywołujący ma_step jest jednym z nich.
+int ma_set_threads(size_t threads) {
+    // Bariera liczy wątki w unsigned
+    if (threads > UINT_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (pool) pool_destroy(pool->size - 1);
+    if (threads <= 1) return 0;
+    pool = (pool_t*)calloc(1, sizeof(pool_t));
+    if (!pool) {
+        errno = ENOMEM;
+        return -1;
+    }
+    pool->threads = (pthread_t*)calloc(threads - 1, sizeof(pthread_t));
+    pool->deques[0] = (deque_t*)calloc(threads, sizeof(deque_t));
+    pool->deques[1] = (deque_t*)calloc(threads, sizeof(deque_t));
+    pool->steals = (size_t*)calloc(threads, sizeof(size_t));
+    if (!pool->threads || !pool->deques[0] || !pool->deques[1] || !pool->steals) {
+        pool_free();
+        errno = ENOMEM;
+        return -1;
+    }
+    pool->size = threads;
+    int err = pthread_mutex_init(&pool->lock, NULL);
+    if (err) {
+        pool_free();
+        errno = err;
+        return -1;
+    }
+    if ((err = pthread_cond_init(&pool->wake, NULL))) {
+        pthread_mutex_destroy(&pool->lock);
+        pool_free();
+        errno = err;
+        return -1;
+    }
+    if ((err = pthread_barrier_init(&pool->barrier, NULL, (unsigned)threads))) {
+        pthread_cond_destroy(&pool->wake);
+        pthread_mutex_destroy(&pool->lock);
+        pool_free();
+        errno = err;
+        return -1;
+    }
+    for (size_t i = 1; i < threads; i++) {
+        err = pthread_create(&pool->threads[i - 1], NULL, pool_worker, (void*)i);
+        if (err) {
+            pool_destroy(i - 1);
+            errno = err;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Wybiera sposób podziału pracy między wątki puli
+int ma_set_schedule(int policy) {
+    if (policy != MA_SCHED_STATIC && policy != MA_SCHED_STEAL) {
+        errno = EINVAL;
+        return -1;
+    }
+    schedule = policy;
+    return 0;
+}
+
+// Zwraca łączną liczbę kradzieży od utworzenia puli, a do counts wpisuje liczby dla pierwszych len wątków
+size_t ma_get_steals(size_t *counts, size_t len) {
+    size_t total = 0;
+    for (size_t i = 0; pool && i < pool->size; i++) {
+        total += pool->steals[i];
+        if (counts && i < len) counts[i] = pool->steals[i];
+    }
+    for (size_t i = pool ? pool->size : 0; counts && i < len; i++) counts[i] = 0;
+    return total;
+}
+
+// Sprawdza tablicę automatów do kroku, w distinct zwraca, czy żaden automat się nie powtarza
+static int check_step(moore_t *at[], size_t num, bool *distinct) {
     if (!at || !num) {
         errno = EINVAL;
         return -1;
     }
+    // Powtórzony automat w at[] nie może być liczony równolegle sam ze sobą
+    *distinct = true;
+    step_stamp++;
     for (size_t i = 0; i < num; i++) {
         if (!at[i]) {
             errno = EINVAL;
             return -1;
         }
+        if (at[i]->stamp == step_stamp) *distinct = false;
+        at[i]->stamp = step_stamp;
+    }
+    return 0;
+}
+
+// Wykonuje steps kroków na sprawdzonej tablicy, przed każdym wołając callback (o ile jest)
+static void run_steps(moore_t *at[], size_t num, size_t steps, bool distinct,
+                      step_callback_t callback, void *arg, ma_group_t *group) {
+    if (pool && distinct && num >= 2 * pool->size) {
+        // Kolejki są pakowane w 32-bitowe połówki, większe kroki dzielimy statycznie
+        job_t job = {at, num, steps, callback, arg, num <= UINT32_MAX ? schedule : MA_SCHED_STATIC,
+                     group};
+        pthread_mutex_lock(&pool->lock);
+        pool->job = job;
+        for (size_t i = 0; i < pool->size; i++)
+            atomic_store(&pool->deques[0][i].range,
+                         PACK_RANGE(num * i / pool->size, num * (i + 1) / pool->size));
+        pool->round++;
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+        pool_work(&job, 0);
+        return;
+    }
+    for (size_t k = 0; k < steps; k++) {
+        if (callback) callback(at, num, k, arg);
+        if (group) group_transition(group, 0, num);
+        else transition_phase(at, 0, num);
+        output_phase(at, 0, num);
+    }
+}
+
+int ma_step(moore_t *at[], size_t num) {
+    bool distinct;
+    if (check_step(at, num, &distinct)) return -1;
+    run_steps(at, num, 1, distinct, NULL, NULL, NULL);
+    return 0;
+}
+
+// Wykonuje steps kroków, sprawdzając argumenty raz. Przed każdym krokiem woła callback
+// (jeśli nie jest NULL) z numerem kroku, np. żeby ustawić nowe wejścia.
+int ma_step_n(moore_t *at[], size_t num, size_t steps, step_callback_t callback, void *arg) {
+    bool distinct;
+    if (!steps) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (check_step(at, num, &distinct)) return -1;
+    run_steps(at, num, steps, distinct, callback, arg, NULL);
+    return 0;
+}
+
+// Układa plan grupy na nowo z aktualnych połączeń członków. Wykrywa usuniętych członków.
+static int group_plan(ma_group_t *g) {
+    for (size_t i = 0; i < g->num; i++) {
+        if (handles.slots[g->slot[i]].gen != g->gen[i]) {
+            g->dead = true;
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < g->num; i++) {
+        plan_sweep(g->at[i], 0, g->at[i]->n);
+        total += g->at[i]->plan_len;
+    }
+    if (total > g->runs_cap) {
+        grun_t *runs = (grun_t*)realloc(g->runs, total * sizeof(grun_t));
+        if (!runs) {
+            errno = ENOMEM;
+            return -1;
+        }
+        g->runs = runs;
+        g->runs_cap = total;
+    }
+    size_t k = 0;
+    for (size_t i = 0; i < g->num; i++) {
+        moore_t const *a = g->at[i];
+        g->first[i] = k;
+        for (size_t r = 0; r < a->plan_len; r++) {
+            run_t const *run = &a->plan[r];
+            grun_t grun = {run->src, run->src_bit, run->dst_bit, run->len, run->seen};
+            g->runs[k++] = grun;
+        }
+    }
+    g->first[g->num] = k;
+    g->epoch = wiring_epoch;
+    return 0;
+}
+
+// Włącza (on != 0) albo wyłącza tryb zdarzeniowy, w którym krok pomija automaty w punkcie stałym
+int ma_set_event_driven(int on) {
+    event_driven = on != 0;
+    return 0;
+}
+
+// Największe n + s, dla którego automat z flagą MA_PURE dostaje tablice
+#define PURE_MAX_BITS 16
+
+// Liczy tablice czystych funkcji automatu, wołając je raz dla każdej pary (wejście, stan)
+static int table_probe(moore_t *a) {
+    size_t states = (size_t)1 << a->s, inputs = (size_t)1 << a->n;
+    uint64_t *out = (uint64_t*)malloc(states * sizeof(uint64_t));
+    uint16_t *next = (uint16_t*)malloc(states * inputs * sizeof(uint16_t));
+    if (!out || !next) {
+        free(out);
+        free(next);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (size_t q = 0; q < states; q++) {
+        uint64_t state = q, output = 0;
+        a->output_function(&output, &state, a->m, a->s);
+        out[q] = output;
+        for (size_t x = 0; x < inputs; x++) {
+            uint64_t input = x, new_state = 0;
+            a->transition(&new_state, &input, &state, a->n, a->s);
+            next[x | q << a->n] = (uint16_t)new_state;
+        }
+    }
+    table_t *t = table_acquire(a->n, a->m, a->s, next, out);
+    free(out);
+    free(next);
+    if (!t) return -1;
+    a->table = t;
+    return 0;
+}
+
+// Ustawia flagi automatu, MA_TIME_DEPENDENT każe liczyć jego przejście w każdym kroku.
+// MA_PURE zapewnia, że funkcje zależą tylko od wejścia i stanu: dla n + s <= PURE_MAX_BITS
+// i m <= 64 biblioteka zamienia je od razu na tablice, tak jak w ma_create_table.
+int ma_set_flags(moore_t *a, unsigned flags) {
+    if (!a || (flags & ~(unsigned)(MA_TIME_DEPENDENT | MA_PURE)) ||
+        ((flags & MA_TIME_DEPENDENT) && (flags & MA_PURE))) {
+        errno = EINVAL;
+        return -1;
+    }
+    // Automaty z ma_create_table i netlist nie mają funkcji do próbkowania, ich tablice zostają
+    bool probed = a->table && a->transition;
+    if ((flags & MA_PURE) && a->transition && !a->table && !a->sliced && !a->family &&
+        a->n + a->s <= PURE_MAX_BITS && a->m <= 64) {
+        if (table_probe(a)) return -1;
+    }
+    else if (!(flags & MA_PURE) && probed) {
+        table_release(a->table);
+        a->table = NULL;
+    }
+    a->flags = flags;
+    return 0;
+}
+
+// Tworzy grupę automatów at[0..num), sprawdzając argumenty i układając plan zbierania wejść raz.
+// Po zmianie połączeń plan jest układany na nowo przy następnym kroku, usunięcie członka unieważnia grupę.
+ma_group_t * ma_group_create(moore_t *at[], size_t num) {
+    bool distinct;
+    if (check_step(at, num, &distinct)) return NULL;
+    ma_group_t *g = (ma_group_t*)calloc(1, sizeof(ma_group_t));
+    if (!g) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    handles.groups++;
+    g->num = num;
+    g->distinct = distinct;
+    g->at = (moore_t**)malloc(num * sizeof(moore_t*));
+    g->slot = (uint32_t*)malloc(num * sizeof(uint32_t));
+    g->gen = (uint32_t*)malloc(num * sizeof(uint32_t));
+    g->first = (size_t*)malloc((num + 1) * sizeof(size_t));
+    if (!g->at || !g->slot || !g->gen || !g->first) {
+        errno = ENOMEM;
+        ma_group_delete(g);
+        return NULL;
     }
     for (size_t i = 0; i < num; i++) {
-        origin_t * origin = at[i]->origins;
-        for (size_t j = 0; j < at[i]->n; j++) {
-            if (origin[j].ma) {
-                size_t out = origin[j].out;
-                at[i]->input[j/64] = COPY(at[i]->input[j/64], origin[j].ma->output[out/64] , j % 64, out % 64);
+        g->at[i] = at[i];
+        g->slot[i] = at[i]->slot;
+        g->gen[i] = handles.slots[at[i]->slot].gen;
+    }
+    if (group_plan(g)) {
+        ma_group_delete(g);
+        return NULL;
+    }
+    return g;
+}
+
+// Wykonuje jeden krok grupy. Zwraca -1 z EINVAL, jeśli któryś członek został usunięty.
+int ma_group_step(ma_group_t *g) {
+    if (!g || g->dead) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (g->epoch != wiring_epoch && group_plan(g)) return -1;
+    run_steps(g->at, g->num, 1, g->distinct, NULL, NULL, g);
+    return 0;
+}
+
+// Zwalnia grupę, nie ruszając jej członków
+void ma_group_delete(ma_group_t *g) {
+    if (!g) {
+        errno = EINVAL;
+        return;
+    }
+    handles.groups--;
+    handles_trim();
+    free(g->at);
+    free(g->slot);
+    free(g->gen);
+    free(g->first);
+    free(g->runs);
+    free(g);
+}
+
+// Najmniejszy kawałek areny sieci
+#define ARENA_CHUNK ((size_t)1 << 20)
+
+// Tworzy pustą sieć automatów
+ma_network_t * ma_network_create(void) {
+    ma_network_t *net = (ma_network_t*)calloc(1, sizeof(ma_network_t));
+    if (!net) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return net;
+}
+
+// Zwraca wyzerowaną, wyrównaną do linii pamięć na size bajtów z areny sieci, NULL dla nieudanej alokacji
+static char * arena_alloc(ma_network_t *net, size_t size) {
+    arena_t *chunk = net->arena;
+    if (!chunk || chunk->size - chunk->used < size) {
+        size_t bytes = size > ARENA_CHUNK ? size : ARENA_CHUNK;
+        if (bytes > SIZE_MAX - sizeof(arena_t) - CACHE_LINE) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        chunk = (arena_t*)calloc(1, sizeof(arena_t) + bytes + CACHE_LINE);
+        if (!chunk) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        uintptr_t data = (uintptr_t)(chunk + 1);
+        chunk->base = (char*)((data + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1));
+        chunk->size = bytes;
+        chunk->next = net->arena;
+        net->arena = chunk;
+    }
+    char *ptr = chunk->base + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+// Odkłada blok usuniętego automatu do ponownego użycia
+static void spare_put(ma_network_t *net, char *base, size_t size) {
+    spare_t *b = (spare_t*)base;
+    b->size = size;
+    b->next = net->spare;
+    net->spare = b;
+}
+
+// Zwraca wyzerowany blok usuniętego automatu o rozmiarze size albo NULL, jeśli takiego nie ma
+static char * spare_take(ma_network_t *net, size_t size) {
+    for (spare_t **p = &net->spare; *p; p = &(*p)->next) {
+        spare_t *b = *p;
+        if (b->size != size) continue;
+        *p = b->next;
+        memset(b, 0, size);
+        return (char*)b;
+    }
+    return NULL;
+}
+
+// Powiększa tablicę *arr do cap elementów rozmiaru size
+static bool grow_array(void **arr, size_t cap, size_t size) {
+    void *p = realloc(*arr, cap * size);
+    if (!p) return false;
+    *arr = p;
+    return true;
+}
+
+// Zapewnia w tablicy members miejsce na extra nowych automatów
+static int network_reserve(ma_network_t *net, size_t extra) {
+    if (extra <= net->cap - net->len) return 0;
+    if (extra > (SIZE_MAX / sizeof(moore_t*) - net->len) / 2) {
+        errno = ENOMEM;
+        return -1;
+    }
+    size_t cap = net->cap ? 2 * net->cap : 16;
+    while (cap < net->len + extra) cap *= 2;
+    if (!grow_array((void**)&net->members, cap, sizeof(moore_t*))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    net->cap = cap;
+    return 0;
+}
+
+// Dopisuje automat do tablicy members sieci, miejsce musi być zarezerwowane
+static void network_attach(ma_network_t *net, moore_t *ma) {
+    size_t i = net->len++;
+    ma->net = net;
+    ma->net_index = i;
+    ma->push = net->push == MA_PUSH_ON;
+    net->members[i] = ma;
+}
+
+// Tworzy automat w arenie sieci. Poza sposobem zwalniania działa jak automat z ma_create_full.
+moore_t * ma_network_add(ma_network_t *net, size_t n, size_t m, size_t s, transition_function_t t,
+                         output_function_t y, uint64_t const *q) {
+    if (!net || !m || !s || !t || !y || !q) {
+        errno = EINVAL;
+        return NULL;
+    }
+    layout_t l = ma_layout(n, m, s, false);
+    if (l.total == SIZE_MAX) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (network_reserve(net, 1)) return NULL;
+    char *base = spare_take(net, l.total);
+    bool reused = base;
+    if (!base && !(base = arena_alloc(net, l.total))) return NULL;
+    moore_t *ma = ma_place(base, &l, n, m, s, t, y, q, NULL);
+    if (!ma) {
+        // Nowy blok jest ostatni w swoim kawałku, więc można go oddać
+        if (reused) spare_put(net, base, l.total);
+        else net->arena->used -= l.total;
+        return NULL;
+    }
+    init_output(ma);
+    network_attach(net, ma);
+    return ma;
+}
+
+// Tworzy w sieci rodzinę k automatów o rozmiarach n, m, s i stanie początkowym q, liczonych wsadowo
+// funkcją t. Wejścia i stany członków leżą kolejno w ciągłych tablicach, wskaźniki na członków
+// trafiają do members[0..k).
+int ma_network_add_family(ma_network_t *net, size_t k, size_t n, size_t m, size_t s,
+                          batch_transition_function_t t, output_function_t y,
+                          uint64_t const *q, moore_t *members[]) {
+    if (!net || !k || !m || !s || !t || !y || !q || !members) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t wn = WORDS64(n), ws = WORDS64(s), total = 0;
+    layout_t l = ma_layout(n, m, s, true);
+    size_t input_at = layout_add(&total, k, wn * sizeof(uint64_t));
+    size_t state_at = layout_add(&total, k, ws * sizeof(uint64_t));
+    size_t new_state_at = layout_add(&total, k, ws * sizeof(uint64_t));
+    if (l.total == SIZE_MAX || total == SIZE_MAX) {
+        errno = ENOMEM;
+        return -1;
+    }
+    family_t *f = (family_t*)calloc(1, sizeof(family_t));
+    if (!f || !(f->members = (moore_t**)calloc(k, sizeof(moore_t*)))) {
+        free(f);
+        errno = ENOMEM;
+        return -1;
+    }
+    char *slab = NULL;
+    if (network_reserve(net, k) || !(slab = arena_alloc(net, total))) {
+        free(f->members);
+        free(f);
+        return -1;
+    }
+    f->batch = t;
+    f->k = k;
+    f->n = n;
+    f->s = s;
+    f->input = (uint64_t*)(slab + input_at);
+    f->state = (uint64_t*)(slab + state_at);
+    f->new_state = (uint64_t*)(slab + new_state_at);
+    for (size_t j = 0; j < k; j++) {
+        uint64_t *slabs[3] = {f->input + j * wn, f->state + j * ws, f->new_state + j * ws};
+        char *base = arena_alloc(net, l.total);
+        moore_t *ma = base ? ma_place(base, &l, n, m, s, NULL, y, q, slabs) : NULL;
+        if (!ma) {
+            for (size_t i = 0; i < j; i++) ma_delete(f->members[i]);
+            free(f->members);
+            free(f);
+            return -1;
+        }
+        init_output(ma);
+        network_attach(net, ma);
+        ma->family = f;
+        ma->family_index = j;
+        f->members[j] = members[j] = ma;
+        f->live++;
+    }
+    f->next = net->families;
+    net->families = f;
+    return 0;
+}
+
+// Wyjmuje usuwany automat z tablicy members sieci, na jego miejsce trafia ostatni. Blok automatu
+// spoza rodziny odkłada do ponownego użycia, bloki członków rodzin zostają w arenie.
+static void network_remove(moore_t *a) {
+    ma_network_t *net = a->net;
+    size_t i = a->net_index, last = --net->len;
+    if (i != last) {
+        net->members[i] = net->members[last];
+        net->members[i]->net_index = i;
+    }
+    if (!a->family) spare_put(net, (char*)a, ma_layout(a->n, a->m, a->s, false).total);
+}
+
+// Ile razy więcej odbiorców niż własnych fragmentów wejścia musi mieć automat, żeby w trybie
+// MA_PUSH_AUTO opłacało mu się wpisywać wyjście odbiorcom
+#define PUSH_RATIO 4
+
+// Wybiera automaty sieci, które wpisują wyjście odbiorcom, i przydziela ich odbiorcom bufory staged
+static void network_choose_push(ma_network_t *net) {
+    for (size_t i = 0; i < net->len; i++) {
+        moore_t *a = net->members[i];
+        if (net->push == MA_PUSH_AUTO) a->push = a->fan_len >= PUSH_RATIO * (a->plan_len + 1);
+        else a->push = net->push == MA_PUSH_ON;
+        if (a->push)
+            for (outList_t *node = a->head->next; node; node = node->next) stage_reserve(node->ma);
+    }
+    net->push_epoch = wiring_epoch;
+}
+
+// Ustawia sposób przekazywania wyjść automatów sieci odbiorcom: MA_PUSH_OFF – odbiorcy sami je
+// czytają, MA_PUSH_ON – automaty wpisują zmienione słowa odbiorcom, MA_PUSH_AUTO – wpisują tylko
+// automaty z dużą liczbą odbiorców w stosunku do liczby własnych połączeń wejściowych
+int ma_network_set_push(ma_network_t *net, int mode) {
+    if (!net || (mode != MA_PUSH_OFF && mode != MA_PUSH_ON && mode != MA_PUSH_AUTO)) {
+        errno = EINVAL;
+        return -1;
+    }
+    net->push = mode;
+    network_choose_push(net);
+    return 0;
+}
+
+// Wykonuje jeden krok wszystkich automatów sieci
+int ma_network_step(ma_network_t *net) {
+    if (!net) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (net->push == MA_PUSH_AUTO && net->push_epoch != wiring_epoch) network_choose_push(net);
+    if (!net->len) return 0;
+    if (!net->families) {
+        run_steps(net->members, net->len, 1, true, NULL, NULL, NULL);
+        return 0;
+    }
+    // Z rodzinami krok jest sekwencyjny: rodziny liczą się jednym wywołaniem, reszta osobno
+    for (family_t *f = net->families; f; f = f->next)
+        if (f->live) family_transition(f);
+    for (size_t i = 0; i < net->len; i++)
+        if (!net->members[i]->family) step_one(net->members[i]);
+    output_phase(net->members, 0, net->len);
+    return 0;
+}
+
+// Usuwa wszystkie automaty sieci i zwalnia jej pamięć
+void ma_network_delete(ma_network_t *net) {
+    if (!net) {
+        errno = EINVAL;
+        return;
+    }
+    while (net->len) ma_delete(net->members[net->len - 1]);
+    while (net->families) {
+        family_t *f = net->families;
+        net->families = f->next;
+        free(f->members);
+        free(f);
+    }
+    while (net->arena) {
+        arena_t *chunk = net->arena;
+        net->arena = chunk->next;
+        free(chunk);
+    }
+    free(net->members);
+    free(net);
+}
+
+// Netlista w budowie: węzły dokładane po kolei, więc argumenty zawsze poprzedzają bramkę
+struct netlist {
+    size_t n, m, s;
+    gate_t *nodes;
+    size_t len, cap;
+    uint32_t *next, *out; // węzeł każdego bitu nowego stanu i wyjścia, NO_NODE dla zera
+    program_t *compiled[2]; // program dla zwykłych i bit-sliced automatów z aktualnej wersji, albo NULL
+};
+
+#define NO_NODE UINT32_MAX
+#define NETLIST_MAX_NODES ((size_t)INT_MAX)
+
+// Tworzy pustą netlistę automatu o n wejściach, m wyjściach i s bitach stanu
+ma_netlist_t * ma_netlist_create(size_t n, size_t m, size_t s) {
+    if (!m || !s || n > UINT32_MAX || m > UINT32_MAX || s > UINT32_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+    ma_netlist_t *nl = (ma_netlist_t*)calloc(1, sizeof(ma_netlist_t));
+    if (!nl) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    nl->n = n;
+    nl->m = m;
+    nl->s = s;
+    nl->next = (uint32_t*)malloc(s * sizeof(uint32_t));
+    nl->out = (uint32_t*)malloc(m * sizeof(uint32_t));
+    if (!nl->next || !nl->out) {
+        ma_netlist_delete(nl);
+        errno = ENOMEM;
+        return NULL;
+    }
+    for (size_t i = 0; i < s; i++) nl->next[i] = NO_NODE;
+    for (size_t i = 0; i < m; i++) nl->out[i] = NO_NODE;
+    return nl;
+}
+
+// Porzuca programy skompilowane z poprzedniej wersji netlisty, automaty zachowują swoje
+static void netlist_changed(ma_netlist_t *nl) {
+    for (size_t i = 0; i < 2; i++) {
+        program_release(nl->compiled[i]);
+        nl->compiled[i] = NULL;
+    }
+}
+
+void ma_netlist_delete(ma_netlist_t *nl) {
+    if (!nl) {
+        errno = EINVAL;
+        return;
+    }
+    netlist_changed(nl);
+    free(nl->nodes);
+    free(nl->next);
+    free(nl->out);
+    free(nl);
+}
+
+// Dokłada węzeł i zwraca jego numer, -1 dla nieudanej alokacji
+static int netlist_add(ma_netlist_t *nl, uint8_t op, uint32_t a, uint32_t b, uint32_t c) {
+    if (nl->len == nl->cap) {
+        size_t cap = nl->cap ? 2 * nl->cap : 64;
+        if (nl->len == NETLIST_MAX_NODES || !grow_array((void**)&nl->nodes, cap, sizeof(gate_t))) {
+            errno = ENOMEM;
+            return -1;
+        }
+        nl->cap = cap;
+    }
+    nl->nodes[nl->len] = (gate_t){op, a, b, c};
+    return (int)nl->len++;
+}
+
+int ma_netlist_input(ma_netlist_t *nl, size_t bit) {
+    if (!nl || bit >= nl->n) {
+        errno = EINVAL;
+        return -1;
+    }
+    return netlist_add(nl, OP_INPUT, (uint32_t)bit, 0, 0);
+}
+
+int ma_netlist_state(ma_netlist_t *nl, size_t bit) {
+    if (!nl || bit >= nl->s) {
+        errno = EINVAL;
+        return -1;
+    }
+    return netlist_add(nl, OP_STATE, (uint32_t)bit, 0, 0);
+}
+
+int ma_netlist_const(ma_netlist_t *nl, int value) {
+    if (!nl) {
+        errno = EINVAL;
+        return -1;
+    }
+    return netlist_add(nl, OP_CONST, value != 0, 0, 0);
+}
+
+// Dokłada bramkę op na wcześniejszych węzłach: MA_GATE_NOT czyta tylko a, MA_GATE_MUX daje
+// b tam, gdzie a jest jedynką, i c tam, gdzie zerem. Nieużywane argumenty są ignorowane.
+int ma_netlist_gate(ma_netlist_t *nl, int op, int a, int b, int c) {
+    if (!nl || op < MA_GATE_AND || op > MA_GATE_MUX) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t arity = op == MA_GATE_NOT ? 1 : op == MA_GATE_MUX ? 3 : 2;
+    int args[3] = {a, b, c};
+    for (size_t i = 0; i < 3; i++) {
+        if (i >= arity) args[i] = 0;
+        else if (args[i] < 0 || (size_t)args[i] >= nl->len) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    return netlist_add(nl, (uint8_t)op, (uint32_t)args[0], (uint32_t)args[1], (uint32_t)args[2]);
+}
+
+// Ustawia węzeł liczący bit nowego stanu, nieustawione bity stanu przechodzą w zero
+int ma_netlist_next(ma_netlist_t *nl, size_t bit, int node) {
+    if (!nl || bit >= nl->s || node < 0 || (size_t)node >= nl->len) {
+        errno = EINVAL;
+        return -1;
+    }
+    nl->next[bit] = (uint32_t)node;
+    netlist_changed(nl);
+    return 0;
+}
+
+// Ustawia węzeł liczący bit wyjścia, który może zależeć tylko od stanu. Nieustawione bity są zerami.
+int ma_netlist_output(ma_netlist_t *nl, size_t bit, int node) {
+    if (!nl || bit >= nl->m || node < 0 || (size_t)node >= nl->len) {
+        errno = EINVAL;
+        return -1;
+    }
+    nl->out[bit] = (uint32_t)node;
+    netlist_changed(nl);
+    return 0;
+}
+
+// Stan kompilacji: węzły po uproszczeniu, każdy różny od pozostałych, i tablica haszująca je
+// po (op, a, b, c). Węzły 0 i 1 to stałe 0 i 1.
+typedef struct {
+    gate_t *nodes;
+    size_t len;
+    uint32_t *hash;
+    size_t hash_cap;
+} folder_t;
+
+// Zwraca węzeł równoważny bramce op(a, b, c) na węzłach już uproszczonych: zwija stałe i powtórzenia
+// argumentów, a identyczne bramki zastępuje jedną (CSE)
+static uint32_t fold(folder_t *f, uint8_t op, uint32_t a, uint32_t b, uint32_t c) {
+    gate_t const *nodes = f->nodes;
+    switch (op) {
+        case MA_GATE_AND:
+            if (a == 0 || b == 0) return 0;
+            if (a == 1 || a == b) return b;
+            if (b == 1) return a;
+            break;
+        case MA_GATE_OR:
+            if (a == 1 || b == 1) return 1;
+            if (a == 0 || a == b) return b;
+            if (b == 0) return a;
+            break;
+        case MA_GATE_XOR:
+            if (a == b) return 0;
+            if (a == 0) return b;
+            if (b == 0) return a;
+            if (a == 1) return fold(f, MA_GATE_NOT, b, 0, 0);
+            if (b == 1) return fold(f, MA_GATE_NOT, a, 0, 0);
+            break;
+        case MA_GATE_NOT:
+            if (a < 2) return 1 - a;
+            if (nodes[a].op == MA_GATE_NOT) return nodes[a].a;
+            break;
+        case MA_GATE_MUX:
+            if (a < 2) return a ? b : c;
+            if (b == c) return b;
+            if (b == 1 && c == 0) return a;
+            if (b == 0 && c == 1) return fold(f, MA_GATE_NOT, a, 0, 0);
+            break;
+    }
+    // Argumenty bramek przemiennych porządkujemy, żeby a & b i b & a trafiały w ten sam węzeł
+    if (op <= MA_GATE_XOR && a > b) {
+        uint32_t t = a;
+        a = b;
+        b = t;
+    }
+    uint64_t key = ((uint64_t)op * 0x9e3779b97f4a7c15ULL) ^ ((uint64_t)a * 0xc2b2ae3d27d4eb4fULL) ^
+                   ((uint64_t)b * 0x165667b19e3779f9ULL) ^ ((uint64_t)c * 0x27d4eb2f165667c5ULL);
+    size_t i = (size_t)(key ^ key >> 29) & (f->hash_cap - 1);
+    for (; f->hash[i] != NO_NODE; i = (i + 1) & (f->hash_cap - 1)) {
+        gate_t const *g = &nodes[f->hash[i]];
+        if (g->op == op && g->a == a && g->b == b && g->c == c) return f->hash[i];
+    }
+    f->nodes[f->len] = (gate_t){op, a, b, c};
+    f->hash[i] = (uint32_t)f->len;
+    return (uint32_t)f->len++;
+}
+
+// Zaznacza w live węzły potrzebne do policzenia count korzeni, zwraca ich liczbę
+static size_t mark_live(folder_t const *f, uint32_t const *roots, size_t count, bool *live) {
+    memset(live, 0, f->len * sizeof(bool));
+    for (size_t j = 0; j < count; j++) live[roots[j]] = true;
+    size_t used = 0;
+    for (size_t i = f->len; i-- > 0;) {
+        if (!live[i]) continue;
+        used++;
+        gate_t const *g = &f->nodes[i];
+        if (g->op > MA_GATE_MUX) continue;
+        live[g->a] = true;
+        if (g->op != MA_GATE_NOT) live[g->b] = true;
+        if (g->op == MA_GATE_MUX) live[g->c] = true;
+    }
+    return used;
+}
+
+// Wypisuje żywe węzły do code w kolejności topologicznej, numerując rejestry od zera,
+// i tłumaczy korzenie na numery rejestrów
+static void emit(folder_t const *f, bool const *live, uint32_t *reg, gate_t *code,
+                 uint32_t const *roots, size_t count, uint32_t *res) {
+    uint32_t len = 0;
+    for (size_t i = 0; i < f->len; i++) {
+        if (!live[i]) continue;
+        gate_t g = f->nodes[i];
+        if (g.op <= MA_GATE_MUX) {
+            g.a = reg[g.a];
+            g.b = g.op == MA_GATE_NOT ? 0 : reg[g.b];
+            g.c = g.op == MA_GATE_MUX ? reg[g.c] : 0;
+        }
+        reg[i] = len;
+        code[len++] = g;
+    }
+    for (size_t j = 0; j < count; j++) res[j] = reg[roots[j]];
+}
+
+// Kompiluje netlistę: upraszcza ją, usuwa powtórzenia i węzły, od których nie zależy żaden
+// bit stanu ani wyjścia, a resztę układa w program
+static program_t * netlist_compile(ma_netlist_t const *nl) {
+    size_t cap = nl->len + 2, hash_cap = 64;
+    while (hash_cap < 2 * cap) hash_cap *= 2;
+    folder_t f = {(gate_t*)malloc(cap * sizeof(gate_t)), 0,
+                  (uint32_t*)malloc(hash_cap * sizeof(uint32_t)), hash_cap};
+    uint32_t *map = (uint32_t*)malloc((nl->len + 1) * sizeof(uint32_t));
+    uint32_t *roots = (uint32_t*)malloc((nl->s + nl->m) * sizeof(uint32_t));
+    bool *live = (bool*)malloc(cap * sizeof(bool));
+    uint32_t *reg = (uint32_t*)malloc(cap * sizeof(uint32_t));
+    program_t *p = NULL;
+    if (!f.nodes || !f.hash || !map || !roots || !live || !reg) {
+        errno = ENOMEM;
+        goto out;
+    }
+    for (size_t i = 0; i < hash_cap; i++) f.hash[i] = NO_NODE;
+    fold(&f, OP_CONST, 0, 0, 0);
+    fold(&f, OP_CONST, 1, 0, 0);
+    // Każdy węzeł netlisty daje najwyżej jeden nowy węzeł, więc cap wystarcza
+    for (size_t i = 0; i < nl->len; i++) {
+        gate_t g = nl->nodes[i];
+        if (g.op == OP_CONST) map[i] = g.a;
+        else if (g.op > MA_GATE_MUX) map[i] = fold(&f, g.op, g.a, 0, 0);
+        else map[i] = fold(&f, g.op, map[g.a], map[g.b], map[g.c]);
+    }
+    for (size_t j = 0; j < nl->s; j++) roots[j] = nl->next[j] == NO_NODE ? 0 : map[nl->next[j]];
+    for (size_t j = 0; j < nl->m; j++) roots[nl->s + j] = nl->out[j] == NO_NODE ? 0 : map[nl->out[j]];
+
+    size_t out_len = mark_live(&f, roots + nl->s, nl->m, live);
+    for (size_t i = 0; i < f.len; i++) {
+        // Wyjście automatu Moore'a nie może zależeć od wejścia
+        if (live[i] && f.nodes[i].op == OP_INPUT) {
+            errno = EINVAL;
+            goto out;
+        }
+    }
+    size_t step_len = mark_live(&f, roots, nl->s, live);
+    size_t regs = step_len > out_len ? step_len : out_len;
+    p = (program_t*)malloc(sizeof(program_t) + (step_len + out_len) * sizeof(gate_t) +
+                           (nl->s + nl->m) * sizeof(uint32_t));
+    if (!p) {
+        errno = ENOMEM;
+        goto out;
+    }
+    p->s = nl->s;
+    p->m = nl->m;
+    p->step_len = step_len;
+    p->out_len = out_len;
+    p->regs = regs;
+    p->refs = 1;
+    p->jit[0] = p->jit[1] = NULL;
+    p->jit_code = NULL;
+    p->jit_size = 0;
+    p->jit_tried = false;
+    p->code = (gate_t*)(p + 1);
+    p->step_res = (uint32_t*)(p->code + step_len + out_len);
+    p->out_res = p->step_res + nl->s;
+    emit(&f, live, reg, p->code, roots, nl->s, p->step_res);
+    mark_live(&f, roots + nl->s, nl->m, live);
+    emit(&f, live, reg, p->code + step_len, roots + nl->s, nl->m, p->out_res);
+out:
+    free(f.nodes);
+    free(f.hash);
+    free(map);
+    free(roots);
+    free(live);
+    free(reg);
+    return p;
+}
+
+#if defined(JIT_SYSV)
+
+// Bufor, do którego kompilator JIT dopisuje kod maszynowy
+typedef struct {
+    uint8_t *code;
+    size_t len;
+} emitter_t;
+
+static void emit_bytes(emitter_t *e, uint8_t const *bytes, size_t len) {
+    memcpy(e->code + e->len, bytes, len);
+    e->len += len;
+}
+
+// Dopisuje instrukcję z operandem [base + disp]: prefix, opcode, modrm z mod = 10 i disp32
+static void emit_mem(emitter_t *e, uint8_t prefix, uint8_t opcode, uint8_t modrm, uint32_t disp) {
+    uint8_t bytes[7] = {prefix, opcode, (uint8_t)(0x80 | modrm),
+                        (uint8_t)disp, (uint8_t)(disp >> 8), (uint8_t)(disp >> 16), (uint8_t)(disp >> 24)};
+    emit_bytes(e, bytes, sizeof(bytes));
+}
+
+// Numery rejestrów w modrm, argumenty funkcji według System V: rdi = dst, rsi = input,
+// rdx = state, rcx = regs. Liczymy w rax, bity wyniku składamy przez r8.
+#define X86_RCX 1
+#define X86_RDX 2
+#define X86_RSI 6
+#define X86_RDI 7
+#define X86_MOV_LOAD 0x8B
+#define X86_MOV_STORE 0x89
+#define X86_AND 0x23
+#define X86_OR 0x0B
+#define X86_XOR 0x33
+
+// Największy rozmiar kodu jednej instrukcji programu (MUX) i jednego bitu wyniku razem z jego słowem
+#define JIT_INSN_BYTES 35
+#define JIT_RESULT_BYTES 27
+
+// Dopisuje kod instrukcji programu, która zapisuje wynik w regs[i]
+static void jit_insn(emitter_t *e, gate_t const *g, size_t i, bool sliced) {
+    switch (g->op) {
+        case OP_INPUT:
+        case OP_STATE: {
+            uint8_t base = g->op == OP_INPUT ? X86_RSI : X86_RDX;
+            if (sliced) emit_mem(e, 0x48, X86_MOV_LOAD, base, 8 * g->a);
+            else {
+                emit_mem(e, 0x48, X86_MOV_LOAD, base, 8 * (g->a / 64));
+                // shr rax, bit; and eax, 1; neg rax
+                uint8_t spread[] = {0x48, 0xC1, 0xE8, (uint8_t)(g->a % 64), 0x83, 0xE0, 0x01, 0x48, 0xF7, 0xD8};
+                emit_bytes(e, spread, sizeof(spread));
             }
+            break;
+        }
+        case OP_CONST: {
+            // mov rax, -1 albo xor eax, eax
+            uint8_t ones[] = {0x48, 0xC7, 0xC0, 0xFF, 0xFF, 0xFF, 0xFF}, zero[] = {0x31, 0xC0};
+            if (g->a) emit_bytes(e, ones, sizeof(ones));
+            else emit_bytes(e, zero, sizeof(zero));
+            break;
+        }
+        case MA_GATE_NOT: {
+            uint8_t not[] = {0x48, 0xF7, 0xD0};
+            emit_mem(e, 0x48, X86_MOV_LOAD, X86_RCX, 8 * g->a);
+            emit_bytes(e, not, sizeof(not));
+            break;
+        }
+        case MA_GATE_MUX:
+            // c ^ ((b ^ c) & a)
+            emit_mem(e, 0x48, X86_MOV_LOAD, X86_RCX, 8 * g->b);
+            emit_mem(e, 0x48, X86_XOR, X86_RCX, 8 * g->c);
+            emit_mem(e, 0x48, X86_AND, X86_RCX, 8 * g->a);
+            emit_mem(e, 0x48, X86_XOR, X86_RCX, 8 * g->c);
+            break;
+        default: {
+            uint8_t op = g->op == MA_GATE_AND ? X86_AND : g->op == MA_GATE_OR ? X86_OR : X86_XOR;
+            emit_mem(e, 0x48, X86_MOV_LOAD, X86_RCX, 8 * g->a);
+            emit_mem(e, 0x48, op, X86_RCX, 8 * g->b);
+            break;
         }
-        transition_function_t t = at[i]->transition;
-        t(at[i]->new_state, at[i]->input, at[i]->state, at[i]->n, at[i]->s);
-        memcpy(at[i]->state, at[i]->new_state, SIZEOF_64_UINT(at[i]->s));
     }
-    for (size_t i = 0; i < num; i++) {
-        output_function_t output_function = at[i]->output_function;
-        output_function(at[i]->output, at[i]->state, at[i]->m, at[i]->s);
+    emit_mem(e, 0x48, X86_MOV_STORE, X86_RCX, 8 * i);
+}
+
+// Dopisuje funkcję liczącą część programu tak jak program_run
+static void jit_section(emitter_t *e, gate_t const *code, size_t len, uint32_t const *res,
+                        size_t count, bool sliced) {
+    for (size_t i = 0; i < len; i++) jit_insn(e, &code[i], i, sliced);
+    if (sliced) {
+        for (size_t j = 0; j < count; j++) {
+            emit_mem(e, 0x48, X86_MOV_LOAD, X86_RCX, 8 * res[j]);
+            emit_mem(e, 0x48, X86_MOV_STORE, X86_RDI, 8 * j);
+        }
     }
+    else {
+        for (size_t w = 0; w < WORDS64(count); w++) {
+            uint8_t zero[] = {0x31, 0xC0};
+            emit_bytes(e, zero, sizeof(zero));
+            for (size_t j = 64 * w; j < count && j < 64 * w + 64; j++) {
+                // mov r8, [rcx + 8 * res]; and r8d, 1; shl r8, j % 64; or rax, r8
+                emit_mem(e, 0x4C, X86_MOV_LOAD, X86_RCX, 8 * res[j]);
+                uint8_t bit[] = {0x41, 0x83, 0xE0, 0x01, 0x49, 0xC1, 0xE0, (uint8_t)(j % 64), 0x4C, 0x09, 0xC0};
+                emit_bytes(e, bit, sizeof(bit));
+            }
+            emit_mem(e, 0x48, X86_MOV_STORE, X86_RDI, 8 * w);
+        }
+    }
+    uint8_t ret = 0xC3;
+    emit_bytes(e, &ret, 1);
+}
+
+// Kompiluje obie części programu do kodu maszynowego w osobnych stronach. Przy niepowodzeniu
+// program zostaje bez kodu i liczy go interpreter.
+static void program_jit(program_t *p, bool sliced) {
+    p->jit_tried = true;
+    size_t len = p->step_len + p->out_len, results = p->s + p->m;
+    // Przesunięcia rejestrów i bitów muszą zmieścić się w disp32
+    size_t widest = p->regs;
+    for (size_t i = 0; i < len; i++) {
+        if ((p->code[i].op == OP_INPUT || p->code[i].op == OP_STATE) && p->code[i].a >= widest)
+            widest = (size_t)p->code[i].a + 1;
+    }
+    if (widest > INT32_MAX / 8 || results > INT32_MAX / 8 || len > SIZE_MAX / 64) return;
+    size_t size = len * JIT_INSN_BYTES + results * JIT_RESULT_BYTES + 64;
+    long page = sysconf(_SC_PAGESIZE);
+    if (page > 0) size = (size + (size_t)page - 1) / (size_t)page * (size_t)page;
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return;
+    emitter_t e = {(uint8_t*)mem, 0};
+    jit_section(&e, p->code, p->step_len, p->step_res, p->s, sliced);
+    size_t out = e.len;
+    jit_section(&e, p->code + p->step_len, p->out_len, p->out_res, p->m, sliced);
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC)) {
+        munmap(mem, size);
+        return;
+    }
+    p->jit_code = mem;
+    p->jit_size = size;
+    // ISO C nie pozwala rzutować wskaźnika na dane na wskaźnik na funkcję, więc kopiujemy bajty
+    uint8_t *entry[2] = {e.code, e.code + out};
+    _Static_assert(sizeof(jit_function_t) == sizeof(uint8_t*), "rozmiary wskaźników na kod i dane");
+    memcpy(&p->jit[0], &entry[0], sizeof(p->jit[0]));
+    memcpy(&p->jit[1], &entry[1], sizeof(p->jit[1]));
+}
+
+#else
+
+// Na innych platformach programy netlist liczy zawsze interpreter
+static void program_jit(program_t *p, bool sliced) {
+    (void)sliced;
+    p->jit_tried = true;
+}
+
+#endif
+
+// Oddaje program netlisty, zwalniając go razem z kodem maszynowym przy ostatnim użytkowniku
+static void program_release(program_t *p) {
+    if (!p || --p->refs) return;
+#if defined(JIT_SYSV)
+    if (p->jit_code) munmap(p->jit_code, p->jit_size);
+#endif
+    free(p);
+}
+
+// Włącza (on != 0) albo wyłącza kompilację do kodu maszynowego automatów tworzonych później
+// z netlist. Bez wsparcia dla architektury automaty liczy interpreter.
+int ma_set_jit(int on) {
+    jit_enabled = on != 0;
     return 0;
 }
 
+// Tworzy automat z programu netlisty. Automaty z tej samej wersji netlisty i o tym samym układzie
+// dzielą jeden program i jego kod maszynowy, każdy ma tylko własne rejestry.
+static moore_t * netlist_automaton(ma_netlist_t *nl, uint64_t const *q, bool sliced) {
+    if (!nl || !q) {
+        errno = EINVAL;
+        return NULL;
+    }
+    program_t *p = nl->compiled[sliced];
+    if (!p) {
+        p = netlist_compile(nl);
+        if (!p) return NULL;
+        nl->compiled[sliced] = p;
+    }
+    if (jit_enabled && !p->jit_tried) program_jit(p, sliced);
+    uint64_t *regs = (uint64_t*)malloc((p->regs ? p->regs : 1) * sizeof(uint64_t));
+    if (!regs) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t lanes = sliced ? 64 : 1;
+    moore_t *ma = create_block(lanes * nl->n, lanes * nl->m, lanes * nl->s, NULL, NULL, q);
+    if (!ma) {
+        free(regs);
+        return NULL;
+    }
+    p->refs++;
+    ma->program = p;
+    ma->regs = regs;
+    ma->native = jit_enabled && p->jit[0];
+    ma->sliced = sliced;
+    init_output(ma);
+    return ma;
+}
+
+// Tworzy automat liczony skompilowaną netlistą. Netlistę można potem zmieniać albo usunąć.
+// Każda instrukcja liczy tu jedną bramkę dla jednego scenariusza, więc zysk względem funkcji
+// użytkownika daje głównie brak jej wywołań; równoległość słów daje ma_create_netlist_sliced.
+moore_t * ma_create_netlist(ma_netlist_t *nl, uint64_t const *q) {
+    return netlist_automaton(nl, q, false);
+}
+
+// Jak ma_create_netlist, ale automat jest bit-sliced jak z ma_create_sliced: każda instrukcja
+// liczy bramkę naraz dla 64 scenariuszy
+moore_t * ma_create_netlist_sliced(ma_netlist_t *nl, uint64_t const *q) {
+    return netlist_automaton(nl, q, true);
+}
+
+// Zwraca 1, jeśli automat liczy swój program kodem maszynowym, 0 jeśli interpreterem albo bez programu
+int ma_get_jit(moore_t const *a) {
+    if (!a) {
+        errno = EINVAL;
+        return -1;
+    }
+    return a->native;
+}
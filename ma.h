@@ -4,15 +4,43 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#define MA_SCHED_STATIC 0
+#define MA_SCHED_STEAL 1
+
+#define MA_TIME_DEPENDENT 1
+#define MA_PURE 2
+
+#define MA_PUSH_OFF 0
+#define MA_PUSH_ON 1
+#define MA_PUSH_AUTO 2
+
+#define MA_GATE_AND 0
+#define MA_GATE_OR 1
+#define MA_GATE_XOR 2
+#define MA_GATE_NOT 3
+#define MA_GATE_MUX 4
+
 typedef struct moore moore_t;
+typedef struct network ma_network_t;
+typedef struct step_group ma_group_t;
+typedef struct netlist ma_netlist_t;
 typedef void (*transition_function_t)(uint64_t *next_state, uint64_t const *input,
                                       uint64_t const *state, size_t n, size_t s);
 typedef void (*output_function_t)(uint64_t *output, uint64_t const *state,
                                   size_t m, size_t s);
+typedef void (*batch_transition_function_t)(uint64_t *next_state, uint64_t const *input,
+                                            uint64_t const *state, size_t n, size_t s, size_t k);
+typedef void (*step_callback_t)(moore_t *at[], size_t num, size_t step, void *arg);
 
 moore_t * ma_create_full(size_t n, size_t m, size_t s, transition_function_t t,
                          output_function_t y, uint64_t const *q);
 moore_t * ma_create_simple(size_t n, size_t m, transition_function_t t);
+moore_t * ma_create_sliced(size_t n, size_t m, size_t s, transition_function_t t,
+                           output_function_t y, uint64_t const *q);
+moore_t * ma_create_table(size_t n, size_t m, size_t s, uint16_t const *next_table,
+                          uint64_t const *out_table, uint64_t const *q);
+int ma_slice_pack(uint64_t *sliced, uint64_t const *lanes, size_t bits);
+int ma_slice_unpack(uint64_t *lanes, uint64_t const *sliced, size_t bits);
 void ma_delete(moore_t *a);
 int ma_connect(moore_t *a_in, size_t in, moore_t *a_out, size_t out, size_t num);
 int ma_disconnect(moore_t *a_in, size_t in, size_t num);
@@ -20,5 +48,35 @@ int ma_set_input(moore_t *a, uint64_t const *input);
 int ma_set_state(moore_t *a, uint64_t const *state);
 uint64_t const * ma_get_output(moore_t const *a);
 int ma_step(moore_t *at[], size_t num);
+int ma_step_n(moore_t *at[], size_t num, size_t steps, step_callback_t callback, void *arg);
+int ma_set_threads(size_t threads);
+int ma_set_schedule(int policy);
+size_t ma_get_steals(size_t *counts, size_t len);
+int ma_set_event_driven(int on);
+int ma_set_flags(moore_t *a, unsigned flags);
+ma_group_t * ma_group_create(moore_t *at[], size_t num);
+int ma_group_step(ma_group_t *g);
+void ma_group_delete(ma_group_t *g);
+ma_network_t * ma_network_create(void);
+moore_t * ma_network_add(ma_network_t *net, size_t n, size_t m, size_t s, transition_function_t t,
+                         output_function_t y, uint64_t const *q);
+int ma_network_add_family(ma_network_t *net, size_t k, size_t n, size_t m, size_t s,
+                          batch_transition_function_t t, output_function_t y,
+                          uint64_t const *q, moore_t *members[]);
+int ma_network_set_push(ma_network_t *net, int mode);
+int ma_network_step(ma_network_t *net);
+void ma_network_delete(ma_network_t *net);
+ma_netlist_t * ma_netlist_create(size_t n, size_t m, size_t s);
+int ma_netlist_input(ma_netlist_t *nl, size_t bit);
+int ma_netlist_state(ma_netlist_t *nl, size_t bit);
+int ma_netlist_const(ma_netlist_t *nl, int value);
+int ma_netlist_gate(ma_netlist_t *nl, int op, int a, int b, int c);
+int ma_netlist_next(ma_netlist_t *nl, size_t bit, int node);
+int ma_netlist_output(ma_netlist_t *nl, size_t bit, int node);
+void ma_netlist_delete(ma_netlist_t *nl);
+moore_t * ma_create_netlist(ma_netlist_t *nl, uint64_t const *q);
+moore_t * ma_create_netlist_sliced(ma_netlist_t *nl, uint64_t const *q);
+int ma_set_jit(int on);
+int ma_get_jit(moore_t const *a);
 
 #endif
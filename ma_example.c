@@ -7,6 +7,7 @@
 #include "memory_tests.h"
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
@@ -545,6 +546,1074 @@ static int connection_stress(void) {
 }
 
 
+static void t_mix(uint64_t *next_state, uint64_t const *input,
+                  uint64_t const *state, size_t n, size_t s) {
+  for (size_t i = 0; i < BITC_TO_64C(s); ++i)
+    next_state[i] = (state[i] << 7 | state[i] >> 57) ^ (i < BITC_TO_64C(n) ? input[i] : 0) ^
+                    (i * 0x9e3779b97f4a7c15ULL);
+}
+
+// Buduje dwie identyczne losowe sieci, jedną liczy sekwencyjnie, drugą pulą wątków
+// i sprawdza, czy wyjścia są identyczne po każdym kroku. Kroki na przemian dzielą pracę
+// statycznie i przez kradzież zadań, kilka automatów jest dużo droższych od reszty.
+static int threads(void) {
+  const size_t N = 300, E = 3000, STEPS = 20;
+  moore_t *a[N], *b[N];
+  size_t w[N];
+  uint64_t *q = malloc(BITC_TO_64C(200000) * sizeof(uint64_t));
+  assert(q);
+  for (size_t i = 0; i < BITC_TO_64C(200000); ++i)
+    q[i] = 0x0123456789abcdefULL * (i + 1);
+
+  srand(2024);
+  for (size_t i = 0; i < N; ++i) {
+    w[i] = i % 50 ? rd(1, 300) : rd(100000, 200000);
+    a[i] = ma_create_full(w[i], w[i], w[i], t_mix, my_identity, q);
+    b[i] = ma_create_full(w[i], w[i], w[i], t_mix, my_identity, q);
+    assert(a[i] && b[i]);
+  }
+  for (size_t e = 0; e < E; ++e) {
+    size_t i = rd(0, N - 1), j = rd(0, N - 1);
+    size_t in = rd(0, w[i] - 1), out = rd(0, w[j] - 1);
+    size_t num = rd(1, MIN(w[i] - in, w[j] - out));
+    if (rd(0, 4)) {
+      CALL(ma_connect(a[i], in, a[j], out, num));
+      CALL(ma_connect(b[i], in, b[j], out, num));
+    } else {
+      CALL(ma_disconnect(a[i], in, num));
+      CALL(ma_disconnect(b[i], in, num));
+    }
+  }
+
+  int result = PASS;
+  size_t steals = 0, counts[8];
+  for (size_t step = 0; step < STEPS && result == PASS; ++step) {
+    CALL(ma_set_threads(1));
+    CALL(ma_step(a, N));
+    CALL(ma_set_threads(4));
+    CALL(ma_set_schedule(step % 2 ? MA_SCHED_STEAL : MA_SCHED_STATIC));
+    CALL(ma_step(b, N));
+    // Pula powstaje od nowa w każdym kroku, więc liczniki zbieramy od razu
+    if (step % 2)
+      steals += ma_get_steals(NULL, 0);
+    for (size_t i = 0; i < N; ++i)
+      if (memcmp(ma_get_output(a[i]), ma_get_output(b[i]), BITC_TO_64C(w[i]) * 8))
+        result = FAIL;
+  }
+  // Szerokie automaty nierówno obciążają wątki, więc przy MA_SCHED_STEAL ktoś musiał kraść
+  ASSERT(steals > 0);
+  memset(counts, 0xff, sizeof(counts));
+  size_t total = ma_get_steals(counts, 8), sum = 0;
+  for (size_t i = 0; i < 4; ++i)
+    sum += counts[i];
+  ASSERT(sum == total);
+  for (size_t i = 4; i < 8; ++i)
+    ASSERT(counts[i] == 0);
+  CALL(ma_set_threads(1));
+  ASSERT(ma_get_steals(counts, 8) == 0 && counts[0] == 0);
+#if SIZE_MAX > UINT_MAX
+  // Liczba wątków, której nie przyjmie bariera, nie może zostać po cichu obcięta
+  errno = 0;
+  ASSERT(ma_set_threads((size_t)UINT_MAX + 2) == -1 && errno == EINVAL);
+#endif
+  CALL(ma_set_schedule(MA_SCHED_STATIC));
+
+  for (size_t i = 0; i < N; ++i) {
+    ma_delete(a[i]);
+    ma_delete(b[i]);
+  }
+  free(q);
+  return result;
+}
+
+// Przed każdym krokiem podaje na wejście pierwszego automatu numer kroku.
+static void feed_step(moore_t *at[], size_t, size_t step, void *arg) {
+  uint64_t x[2] = {step, *(uint64_t *)arg};
+  ma_set_input(at[0], x);
+}
+
+// Porównuje ma_step_n z callbackiem z tyloma samymi wywołaniami ma_step,
+// sekwencyjnie i na puli wątków.
+static int step_n(void) {
+  const size_t N = 64, STEPS = 50;
+  moore_t *a[N], *b[N];
+  uint64_t q[2] = {0x5555555555555555ULL, 0x3333333333333333ULL}, salt = 77;
+
+  for (size_t i = 0; i < N; ++i) {
+    a[i] = ma_create_full(128, 128, 128, t_mix, my_identity, q);
+    b[i] = ma_create_full(128, 128, 128, t_mix, my_identity, q);
+    assert(a[i] && b[i]);
+  }
+  for (size_t i = 1; i < N; ++i) {
+    CALL(ma_connect(a[i], 0, a[i - 1], 32, 96));
+    CALL(ma_connect(b[i], 0, b[i - 1], 32, 96));
+    CALL(ma_connect(a[i], 100, a[(i * 7) % N], 0, 28));
+    CALL(ma_connect(b[i], 100, b[(i * 7) % N], 0, 28));
+  }
+
+  int result = PASS;
+  for (size_t threads = 1; threads <= 4; threads += 3) {
+    CALL(ma_set_threads(threads));
+    for (size_t k = 0; k < STEPS; ++k) {
+      feed_step(a, N, k, &salt);
+      CALL(ma_step(a, N));
+    }
+    CALL(ma_step_n(b, N, STEPS, feed_step, &salt));
+    for (size_t i = 0; i < N; ++i)
+      if (memcmp(ma_get_output(a[i]), ma_get_output(b[i]), 2 * sizeof(uint64_t)))
+        result = FAIL;
+  }
+  CALL(ma_set_threads(1));
+  errno = 0;
+  if (ma_step_n(b, N, 0, NULL, NULL) != -1 || errno != EINVAL)
+    result = FAIL;
+
+  for (size_t i = 0; i < N; ++i) {
+    ma_delete(a[i]);
+    ma_delete(b[i]);
+  }
+  return result;
+}
+
+static size_t y_calls;
+
+static void y_counted(uint64_t *output, uint64_t const *state, size_t, size_t) {
+  ++y_calls;
+  output[0] = state[0] + 1;
+}
+
+// Sprawdza, że funkcja wyjścia jest wołana tylko po faktycznej zmianie stanu.
+static int cached_output(void) {
+  const uint64_t q = 5, x = 0, *y;
+
+  y_calls = 0;
+  moore_t *a = ma_create_full(64, 64, 64, t_one, y_counted, &q);
+  assert(a);
+  ASSERT(y_calls == 1);
+  for (int i = 0; i < 10; ++i)
+    ASSERT((y = ma_get_output(a)) != NULL && y[0] == 6);
+  ASSERT(y_calls == 1);
+  ASSERT(ma_set_input(a, &x) == 0);
+  ASSERT(ma_step(&a, 1) == 0);
+  ASSERT(y[0] == 6 && y_calls == 1);
+  ASSERT(ma_set_state(a, &q) == 0);
+  ASSERT(y_calls == 1);
+  ASSERT(ma_set_input(a, &q) == 0);
+  ASSERT(ma_step(&a, 1) == 0);
+  ASSERT(y[0] == 11 && y_calls == 2);
+  ASSERT(ma_get_output(a)[0] == 11 && y_calls == 2);
+
+  ma_delete(a);
+  return PASS;
+}
+
+// Jeden automat zasila bardzo wiele innych, każdy przez kilka połączeń.
+static int fan_out(void) {
+  const size_t N = 20000;
+  const uint64_t v = 0x0123456789abcdefULL, zero = 0;
+  moore_t *p = ma_create_simple(64, 64, t_two);
+  moore_t **c = (moore_t **)malloc(N * sizeof(moore_t *));
+  assert(p && c);
+  ASSERT(ma_set_input(p, &zero) == 0);
+  ASSERT(ma_set_state(p, &v) == 0);
+  for (size_t i = 0; i < N; ++i) {
+    c[i] = ma_create_simple(64, 64, t_two);
+    assert(c[i]);
+    ASSERT(ma_connect(c[i], 0, p, 0, 32) == 0);
+    ASSERT(ma_connect(c[i], 32, p, 32, 32) == 0);
+  }
+  // Ponowne podłączenie tego samego automatu nie może dodać nowego node'a
+  for (size_t i = 0; i < N; i += 2)
+    ASSERT(ma_connect(c[i], 16, p, 16, 32) == 0);
+  ASSERT(ma_step(c, N) == 0);
+  for (size_t i = 0; i < N; ++i)
+    ASSERT(ma_get_output(c[i])[0] == v);
+
+  for (size_t i = 0; i < N; i += 2)
+    ma_delete(c[i]);
+  ma_delete(p);
+  for (size_t i = 1; i < N; i += 2)
+    ma_delete(c[i]);
+  free(c);
+  return PASS;
+}
+
+// Usuwa małe źródła podłączone do bardzo szerokiego automatu, reszta połączeń
+// szerokiego automatu ma działać dalej.
+static int delete_wide(void) {
+  const size_t N = 1 << 20, K = 1000;
+  const uint64_t v = 0xfedcba9876543210ULL, zero = 0;
+  moore_t *w = ma_create_simple(N, 64, t_two);
+  moore_t *src[K];
+  assert(w);
+  for (size_t k = 0; k < K; ++k) {
+    src[k] = ma_create_simple(64, 64, t_two);
+    assert(src[k]);
+    ASSERT(ma_set_input(src[k], &zero) == 0);
+    ASSERT(ma_set_state(src[k], &v) == 0);
+    ASSERT(ma_connect(w, k * (N / K), src[k], 0, 64) == 0);
+  }
+  // Bity 0..63 wejścia zasila src[0], zostawiamy tylko go
+  for (size_t k = 1; k < K; ++k)
+    ma_delete(src[k]);
+  ASSERT(ma_step(&w, 1) == 0);
+  ASSERT(ma_get_output(w)[0] == v);
+  ASSERT(ma_step(&w, 1) == 0);
+  ASSERT(ma_get_output(w)[0] == 0);
+  // Odłączone wejście zachowuje ostatnią wartość
+  ma_delete(src[0]);
+  ASSERT(ma_step(&w, 1) == 0);
+  ASSERT(ma_get_output(w)[0] == v);
+  ma_delete(w);
+  return PASS;
+}
+
+// Wielokrotnie podłącza i odłącza nowe automaty do jednego źródła. Po pierwszej rundzie
+// liczba niezwolnionych bloków pamięci nie może już rosnąć, a samo przełączanie połączenia
+// nie powinno alokować.
+static int rewire_churn(void) {
+  const size_t N = 100, ROUNDS = 50;
+  const uint64_t v = 0x00ff00ff00ff00ffULL, zero = 0;
+  memory_test_data_t *mtd = get_memory_test_data();
+  moore_t *p = ma_create_simple(64, 64, t_two);
+  moore_t *keep = ma_create_simple(64, 64, t_two);
+  moore_t *c[N];
+  assert(p && keep);
+  ASSERT(ma_set_input(p, &zero) == 0);
+  ASSERT(ma_set_state(p, &v) == 0);
+  ASSERT(ma_connect(keep, 0, p, 0, 64) == 0);
+
+  unsigned outstanding = 0;
+  for (size_t round = 0; round < ROUNDS; ++round) {
+    for (size_t i = 0; i < N; ++i) {
+      c[i] = ma_create_simple(64, 64, t_two);
+      assert(c[i]);
+      ASSERT(ma_connect(c[i], 0, p, 0, 32) == 0);
+      ASSERT(ma_connect(c[i], 40, p, 8, 24) == 0);
+    }
+    // Połowa odbiorców odłącza się sama, druga połowa znika razem z połączeniami
+    for (size_t i = 0; i < N; i += 2) {
+      ASSERT(ma_disconnect(c[i], 0, 16) == 0);
+      ASSERT(ma_disconnect(c[i], 16, 48) == 0);
+    }
+    ASSERT(ma_step(c, N) == 0);
+    for (size_t i = 0; i < N; ++i)
+      ASSERT(ma_get_output(c[i])[0] == (i % 2 ? (v & 0xffffffffULL) | (v >> 8) << 40 : 0));
+    for (size_t i = 0; i < N; ++i)
+      ma_delete(c[i]);
+    if (round == 0)
+      outstanding = mtd->alloc_counter - mtd->free_counter;
+    ASSERT(mtd->alloc_counter - mtd->free_counter == outstanding);
+  }
+
+  // Jedno połączenie podłączane i odłączane raz za razem nie może alokować przy każdym ma_connect
+  ASSERT(ma_disconnect(keep, 0, 64) == 0);
+  unsigned allocs = mtd->alloc_counter;
+  for (size_t i = 0; i < 1000; ++i) {
+    ASSERT(ma_connect(keep, 0, p, 0, 64) == 0);
+    ASSERT(ma_disconnect(keep, 0, 64) == 0);
+  }
+  ASSERT(mtd->alloc_counter - allocs <= 2);
+
+  ma_delete(keep);
+  ma_delete(p);
+  return PASS;
+}
+
+// Buduje tę samą losową sieć z osobnych automatów i w ma_network_t, w połowie usuwa
+// część automatów i sprawdza, czy oba sposoby liczą to samo.
+static int network(void) {
+  const size_t N = 200, E = 2000, STEPS = 20;
+  moore_t *a[N], *b[N];
+  size_t w[N];
+  uint64_t q[5] = {1, 2, 3, 4, 5};
+
+  srand(77);
+  ma_network_t *net = ma_network_create();
+  assert(net);
+  for (size_t i = 0; i < N; ++i) {
+    w[i] = rd(1, 300);
+    a[i] = ma_create_full(w[i], w[i], w[i], t_mix, my_identity, q);
+    b[i] = ma_network_add(net, w[i], w[i], w[i], t_mix, my_identity, q);
+    assert(a[i] && b[i]);
+  }
+  for (size_t e = 0; e < E; ++e) {
+    size_t i = rd(0, N - 1), j = rd(0, N - 1);
+    size_t in = rd(0, w[i] - 1), out = rd(0, w[j] - 1);
+    size_t num = rd(1, MIN(w[i] - in, w[j] - out));
+    CALL(ma_connect(a[i], in, a[j], out, num));
+    CALL(ma_connect(b[i], in, b[j], out, num));
+  }
+
+  size_t live = N;
+  for (size_t step = 0; step < STEPS; ++step) {
+    if (step == STEPS / 2) {
+      // Usuwa co trzeci automat, pozostałe przesuwa na początek tablic
+      size_t k = 0;
+      for (size_t i = 0; i < live; ++i) {
+        if (i % 3 == 0) {
+          ma_delete(a[i]);
+          ma_delete(b[i]);
+        } else {
+          a[k] = a[i];
+          b[k] = b[i];
+          w[k++] = w[i];
+        }
+      }
+      live = k;
+    }
+    CALL(ma_step(a, live));
+    CALL(ma_network_step(net));
+    for (size_t i = 0; i < live; ++i)
+      ASSERT(memcmp(ma_get_output(a[i]), ma_get_output(b[i]), BITC_TO_64C(w[i]) * 8) == 0);
+  }
+
+  for (size_t i = 0; i < live; ++i)
+    ma_delete(a[i]);
+
+  // Automaty dodawane i usuwane raz za razem dostają bloki usuniętych, sieć nie rośnie
+  // Wejście usuniętego automatu nie może przejść na następnego
+  static uint64_t big[BITC_TO_64C(4096)] = {7}, ones[BITC_TO_64C(4096)];
+  memset(ones, 0xff, sizeof(ones));
+  memory_test_data_t *mtd = get_memory_test_data();
+  unsigned allocs = mtd->alloc_counter;
+  for (size_t i = 0; i < 1000; ++i) {
+    moore_t *c = ma_network_add(net, 4096, 4096, 4096, t_mix, my_identity, big);
+    assert(c);
+    CALL(ma_step(&c, 1));
+    ASSERT(ma_get_output(c)[0] == 7 << 7 && ma_get_output(c)[1] == 0x9e3779b97f4a7c15ULL);
+    CALL(ma_set_input(c, ones));
+    ma_delete(c);
+  }
+  ASSERT(mtd->alloc_counter - allocs <= 1);
+  ma_network_delete(net);
+  return PASS;
+}
+
+// Porównuje krok przygotowanej grupy z ma_step, także po zmianie połączeń
+// i na puli wątków. Usunięcie członka unieważnia grupę.
+static int group(void) {
+  const size_t N = 64, STEPS = 30;
+  moore_t *a[N], *b[N];
+  uint64_t q[2] = {0x0f0f0f0f0f0f0f0fULL, 0x1234567812345678ULL};
+
+  for (size_t i = 0; i < N; ++i) {
+    a[i] = ma_create_full(128, 128, 128, t_mix, my_identity, q);
+    b[i] = ma_create_full(128, 128, 128, t_mix, my_identity, q);
+    assert(a[i] && b[i]);
+  }
+  for (size_t i = 1; i < N; ++i) {
+    CALL(ma_connect(a[i], 0, a[i - 1], 64, 64));
+    CALL(ma_connect(b[i], 0, b[i - 1], 64, 64));
+  }
+  ma_group_t *g = ma_group_create(b, N);
+  assert(g);
+
+  for (size_t step = 0; step < STEPS; ++step) {
+    if (step == STEPS / 3) {
+      CALL(ma_connect(a[0], 10, a[N - 1], 3, 100));
+      CALL(ma_connect(b[0], 10, b[N - 1], 3, 100));
+      CALL(ma_disconnect(a[5], 20, 30));
+      CALL(ma_disconnect(b[5], 20, 30));
+    }
+    CALL(ma_set_threads(step < STEPS / 2 ? 1 : 4));
+    CALL(ma_step(a, N));
+    CALL(ma_group_step(g));
+    for (size_t i = 0; i < N; ++i)
+      ASSERT(memcmp(ma_get_output(a[i]), ma_get_output(b[i]), 2 * sizeof(uint64_t)) == 0);
+  }
+  CALL(ma_set_threads(1));
+
+  ma_delete(b[7]);
+  errno = 0;
+  ASSERT(ma_group_step(g) == -1 && errno == EINVAL);
+  for (size_t i = 0; i < N; ++i) {
+    ma_delete(a[i]);
+    if (i != 7)
+      ma_delete(b[i]);
+  }
+  ma_group_delete(g);
+  return PASS;
+}
+
+static size_t t_calls;
+
+// Stan zbiera jedynki z wejścia, więc szybko trafia w punkt stały.
+static void t_or_counted(uint64_t *next_state, uint64_t const *input,
+                         uint64_t const *state, size_t, size_t) {
+  ++t_calls;
+  next_state[0] = state[0] | input[0];
+}
+
+// Porównuje tryb zdarzeniowy ze zwykłym na łańcuchu automatów, który zwykle stoi.
+// Automat zależny od czasu musi być liczony w każdym kroku.
+static int event_driven(void) {
+  const size_t N = 100, STEPS = 300;
+  const uint64_t zero = 0;
+  moore_t *a[N + 1], *b[N + 1];
+
+  for (size_t i = 0; i <= N; ++i) {
+    a[i] = ma_create_simple(64, 64, t_or_counted);
+    b[i] = ma_create_simple(64, 64, t_or_counted);
+    assert(a[i] && b[i]);
+  }
+  for (size_t i = 1; i < N; ++i) {
+    CALL(ma_connect(a[i], 0, a[i - 1], 0, 64));
+    CALL(ma_connect(b[i], 0, b[i - 1], 0, 64));
+  }
+  // Ostatni automat nie ma wejść, ale udaje zależność od czasu
+  CALL(ma_set_flags(b[N], MA_TIME_DEPENDENT));
+  errno = 0;
+  ASSERT(ma_set_flags(b[N], MA_PURE << 1) == -1 && errno == EINVAL);
+
+  size_t plain = 0, event = 0;
+  for (size_t step = 0; step < STEPS; ++step) {
+    // Co sto kroków na wejście pierwszego automatu trafia nowy bit
+    uint64_t x = (uint64_t)1 << (step / 100);
+    CALL(ma_set_input(a[0], step % 100 ? &zero : &x));
+    CALL(ma_set_input(b[0], step % 100 ? &zero : &x));
+    t_calls = 0;
+    CALL(ma_set_event_driven(0));
+    CALL(ma_step(a, N + 1));
+    plain += t_calls;
+    t_calls = 0;
+    CALL(ma_set_event_driven(1));
+    CALL(ma_step(b, N + 1));
+    event += t_calls;
+    for (size_t i = 0; i <= N; ++i)
+      ASSERT(ma_get_output(a[i])[0] == ma_get_output(b[i])[0]);
+  }
+  CALL(ma_set_event_driven(0));
+  ASSERT(plain == STEPS * (N + 1));
+  // Przy każdej zmianie fala przechodzi przez łańcuch, potem liczy się tylko b[N]
+  ASSERT(event >= STEPS && event < plain / 10);
+
+  for (size_t i = 0; i <= N; ++i) {
+    ma_delete(a[i]);
+    ma_delete(b[i]);
+  }
+  return PASS;
+}
+
+// Przepisuje stan i zmienia w nim jedno słowo wskazane przez wejście.
+static void t_flip_word(uint64_t *next_state, uint64_t const *input,
+                        uint64_t const *state, size_t, size_t s) {
+  memcpy(next_state, state, BITC_TO_64C(s) * sizeof(uint64_t));
+  next_state[input[0] % BITC_TO_64C(s)] ^= input[0] | 1;
+}
+
+// Nowym stanem jest wejście.
+static void t_copy_input(uint64_t *next_state, uint64_t const *input,
+                         uint64_t const *, size_t n, size_t) {
+  memcpy(next_state, input, BITC_TO_64C(n) * sizeof(uint64_t));
+}
+
+static bool get_bit(uint64_t const *arr, size_t i) {
+  return arr[i / 64] >> (i % 64) & 1;
+}
+
+// Szeroka magistrala, na której w każdym kroku zmienia się jedno słowo. Odbiorca
+// czyta ją z przesunięciem, żeby słowa źródła i wejścia nie były wyrównane.
+static int sparse_bus(void) {
+  const size_t W = 1 << 20, SHIFT = 13, STEPS = 40;
+  uint64_t *q = calloc(BITC_TO_64C(W), sizeof(uint64_t));
+  uint64_t *before = malloc(BITC_TO_64C(W) * sizeof(uint64_t));
+  assert(q && before);
+  moore_t *at[2];
+  at[0] = ma_create_full(64, W, W, t_flip_word, my_identity, q);
+  at[1] = ma_create_full(W, W, W, t_copy_input, my_identity, q);
+  assert(at[0] && at[1]);
+  CALL(ma_connect(at[1], 0, at[0], SHIFT, W - SHIFT));
+
+  for (uint64_t k = 0; k < STEPS; ++k) {
+    uint64_t x = k * 2654435761ULL;
+    CALL(ma_set_input(at[0], &x));
+    memcpy(before, ma_get_output(at[0]), BITC_TO_64C(W) * sizeof(uint64_t));
+    CALL(ma_step(at, 2));
+    uint64_t const *y = ma_get_output(at[1]);
+    for (size_t i = 0; i < W - SHIFT; ++i)
+      ASSERT(get_bit(y, i) == get_bit(before, i + SHIFT));
+  }
+
+  ma_delete(at[0]);
+  ma_delete(at[1]);
+  free(q);
+  free(before);
+  return PASS;
+}
+
+// Grupa w trybie zdarzeniowym po usunięciu źródła ma liczyć to samo co zwykły krok.
+// Wersje wyjść są tak dobrane, że suma wersji pozostałych źródeł odbiorcy nie zmienia się
+// przy usunięciu, więc odbiorca musi zauważyć utratę fragmentu planu w inny sposób.
+static int group_event(void) {
+  const uint64_t q[2] = {0, 0}, one = 1, y = 0xabcdefULL;
+  moore_t *p[2], *a[2], *b[2];
+
+  for (size_t k = 0; k < 2; ++k) {
+    moore_t **at = k ? b : a;
+    p[k] = ma_create_simple(64, 64, t_copy_input);
+    at[0] = ma_create_simple(64, 64, t_copy_input);
+    at[1] = ma_create_full(128, 128, 128, t_copy_input, my_identity, q);
+    assert(p[k] && at[0] && at[1]);
+    CALL(ma_connect(at[1], 0, p[k], 0, 64));
+    CALL(ma_connect(at[1], 64, at[0], 0, 64));
+    CALL(ma_set_state(p[k], &one));
+  }
+  ma_group_t *g = ma_group_create(b, 2);
+  assert(g);
+
+  for (size_t step = 0; step < 6; ++step) {
+    if (step == 2) {
+      CALL(ma_set_input(a[0], &y));
+      CALL(ma_set_input(b[0], &y));
+    }
+    if (step == 3) {
+      ma_delete(p[0]);
+      ma_delete(p[1]);
+    }
+    CALL(ma_set_event_driven(0));
+    CALL(ma_step(a, 2));
+    CALL(ma_set_event_driven(1));
+    CALL(ma_group_step(g));
+    for (size_t i = 0; i < 2; ++i)
+      ASSERT(memcmp(ma_get_output(a[i]), ma_get_output(b[i]), 2 * sizeof(uint64_t)) == 0);
+  }
+  CALL(ma_set_event_driven(0));
+  ASSERT(ma_get_output(b[1])[1] == y);
+
+  ma_group_delete(g);
+  for (size_t i = 0; i < 2; ++i) {
+    ma_delete(a[i]);
+    ma_delete(b[i]);
+  }
+  return PASS;
+}
+
+// Jedno źródło zasila tysiące automatów. Sieć liczona z wpisywaniem wyjść odbiorcom
+// (włączonym, automatycznym i wyłączonym) ma dawać to samo co osobne automaty.
+static int push(void) {
+  const size_t N = 2000, STEPS = 24;
+  const int modes[3] = {MA_PUSH_ON, MA_PUSH_AUTO, MA_PUSH_OFF};
+  moore_t *a[N + 1], *b[N + 1];
+  uint64_t q[4] = {3, 1, 4, 1};
+
+  ma_network_t *net = ma_network_create();
+  assert(net);
+  for (size_t i = 0; i <= N; ++i) {
+    a[i] = ma_create_full(200, 200, 200, t_mix, my_identity, q);
+    b[i] = ma_network_add(net, 200, 200, 200, t_mix, my_identity, q);
+    assert(a[i] && b[i]);
+  }
+  // a[0] jest zegarem dla wszystkich, a część automatów czyta też sąsiada
+  for (size_t i = 1; i <= N; ++i) {
+    CALL(ma_connect(a[i], i % 50, a[0], i % 70, 120));
+    CALL(ma_connect(b[i], i % 50, b[0], i % 70, 120));
+    if (i % 3 == 0) {
+      CALL(ma_connect(a[i], 150, a[i - 1], 7, 50));
+      CALL(ma_connect(b[i], 150, b[i - 1], 7, 50));
+    }
+  }
+  errno = 0;
+  ASSERT(ma_network_set_push(net, 5) == -1 && errno == EINVAL);
+
+  for (size_t step = 0; step < STEPS; ++step) {
+    CALL(ma_network_set_push(net, modes[step / 4 % 3]));
+    CALL(ma_set_threads(step % 2 ? 4 : 1));
+    if (step == STEPS / 2) {
+      CALL(ma_disconnect(a[10], 0, 100));
+      CALL(ma_disconnect(b[10], 0, 100));
+      CALL(ma_connect(a[11], 20, a[0], 0, 30));
+      CALL(ma_connect(b[11], 20, b[0], 0, 30));
+    }
+    CALL(ma_step(a, N + 1));
+    CALL(ma_network_step(net));
+    for (size_t i = 0; i <= N; ++i)
+      ASSERT(memcmp(ma_get_output(a[i]), ma_get_output(b[i]), 4 * sizeof(uint64_t)) == 0);
+  }
+  CALL(ma_set_threads(1));
+
+  for (size_t i = 0; i <= N; ++i)
+    ma_delete(a[i]);
+  ma_network_delete(net);
+
+  // Odłączone wejście i wejście od usuniętego źródła zachowują ostatnią zebraną wartość także
+  // wtedy, gdy źródło zdążyło już wepchnąć następną
+  const uint64_t one = 1, ten = 10;
+  for (size_t k = 0; k < 4; ++k) {
+    net = ma_network_create();
+    assert(net);
+    moore_t *p = ma_network_add(net, 8, 8, 8, t_one, my_identity, &ten);
+    moore_t *c = ma_network_add(net, 8, 8, 8, t_copy_input, my_identity, &one);
+    assert(p && c);
+    CALL(ma_connect(c, 0, p, 0, 8));
+    CALL(ma_set_input(p, &one));
+    CALL(ma_network_set_push(net, k % 2 ? MA_PUSH_ON : MA_PUSH_OFF));
+    CALL(ma_network_step(net));
+    ASSERT(ma_get_output(p)[0] == 11 && ma_get_output(c)[0] == 10);
+    if (k < 2)
+      CALL(ma_disconnect(c, 0, 8));
+    else
+      ma_delete(p);
+    CALL(ma_step(&c, 1));
+    ASSERT(ma_get_output(c)[0] == 10);
+    ma_network_delete(net);
+  }
+  return PASS;
+}
+
+// Wsadowa wersja t_mix dla k automatów, których wejścia i stany leżą kolejno.
+static void t_mix_batch(uint64_t *next_state, uint64_t const *input,
+                        uint64_t const *state, size_t n, size_t s, size_t k) {
+  for (size_t j = 0; j < k; ++j)
+    t_mix(next_state + j * BITC_TO_64C(s), input + j * BITC_TO_64C(n),
+          state + j * BITC_TO_64C(s), n, s);
+}
+
+// Rodzina automatów liczonych wsadowo ma dawać to samo co osobne automaty, także po
+// usunięciu członka i przy liczeniu członka samodzielnie przez ma_step.
+static int family(void) {
+  const size_t K = 1000, STEPS = 20;
+  moore_t *a[K + 1], *b[K + 1];
+  uint64_t q[2] = {0xdeadbeefULL, 0xcafebabeULL};
+
+  ma_network_t *net = ma_network_create();
+  assert(net);
+  for (size_t i = 0; i < K; ++i) {
+    a[i] = ma_create_full(100, 100, 100, t_mix, my_identity, q);
+    assert(a[i]);
+  }
+  CALL(ma_network_add_family(net, K, 100, 100, 100, t_mix_batch, my_identity, q, b));
+  a[K] = ma_create_full(64, 64, 64, t_mix, my_identity, q);
+  b[K] = ma_network_add(net, 64, 64, 64, t_mix, my_identity, q);
+  assert(a[K] && b[K]);
+  for (size_t i = 0; i < K; ++i) {
+    CALL(ma_connect(a[i], 0, a[(i + 1) % K], 30, 70));
+    CALL(ma_connect(b[i], 0, b[(i + 1) % K], 30, 70));
+    CALL(ma_connect(a[i], 80, a[K], i % 40, 20));
+    CALL(ma_connect(b[i], 80, b[K], i % 40, 20));
+  }
+  CALL(ma_connect(a[K], 0, a[5], 0, 64));
+  CALL(ma_connect(b[K], 0, b[5], 0, 64));
+
+  size_t live = K + 1;
+  for (size_t step = 0; step < STEPS; ++step) {
+    if (step == STEPS / 2) {
+      ma_delete(a[17]);
+      ma_delete(b[17]);
+      a[17] = a[--live];
+      b[17] = b[live];
+    }
+    if (step % 4 == 3) {
+      // Członkowie rodziny liczeni osobno, bez funkcji wsadowej na całej rodzinie
+      CALL(ma_step(a, live));
+      CALL(ma_step(b, live));
+    } else {
+      CALL(ma_step(a, live));
+      CALL(ma_network_step(net));
+    }
+    for (size_t i = 0; i < live; ++i)
+      ASSERT(memcmp(ma_get_output(a[i]), ma_get_output(b[i]), 2 * sizeof(uint64_t)) == 0);
+  }
+
+  for (size_t i = 0; i < live; ++i)
+    ma_delete(a[i]);
+  ma_network_delete(net);
+  return PASS;
+}
+
+// Logika jednego scenariusza: bit i nowego stanu to state[i+7] ^ (input[i] & state[i+3]) (mod 8)
+static void t_logic(uint64_t *next_state, uint64_t const *input,
+                    uint64_t const *state, size_t n, size_t s) {
+  uint64_t q = state[0], x = input[0];
+  uint64_t r7 = ((q >> 7) | (q << 1)) & 0xff, r3 = ((q >> 3) | (q << 5)) & 0xff;
+  next_state[0] = r7 ^ (x & r3);
+}
+
+// Ta sama logika dla 64 scenariuszy naraz: bit i to całe słowo i
+static void t_logic_sliced(uint64_t *next_state, uint64_t const *input,
+                           uint64_t const *state, size_t n, size_t s) {
+  for (size_t i = 0; i < 8; ++i)
+    next_state[i] = state[(i + 7) % 8] ^ (input[i] & state[(i + 3) % 8]);
+}
+
+// Wyjście równe stanowi, dla s słów scenariuszy
+static void y_sliced(uint64_t *output, uint64_t const *state, size_t m, size_t s) {
+  memcpy(output, state, s * sizeof(uint64_t));
+}
+
+static int sliced(void) {
+  const size_t L = 64, STEPS = 30;
+  moore_t *all[2 * L], **a = all, **b = all + L;
+  uint64_t qa[L], qb[L], in[L], out[L], packed_qa[8], packed_qb[8], packed_in[8];
+
+  for (size_t j = 0; j < L; ++j) {
+    qa[j] = rd(0, 255);
+    qb[j] = rd(0, 255);
+    a[j] = ma_create_full(8, 8, 8, t_logic, my_identity, &qa[j]);
+    b[j] = ma_create_full(8, 8, 8, t_logic, my_identity, &qb[j]);
+    assert(a[j] && b[j]);
+    CALL(ma_connect(b[j], 0, a[j], 2, 6));
+  }
+  CALL(ma_slice_pack(packed_qa, qa, 8));
+  CALL(ma_slice_pack(packed_qb, qb, 8));
+  moore_t *sa = ma_create_sliced(8, 8, 8, t_logic_sliced, y_sliced, packed_qa);
+  moore_t *sb = ma_create_sliced(8, 8, 8, t_logic_sliced, y_sliced, packed_qb);
+  assert(sa && sb);
+  CALL(ma_connect(sb, 0, sa, 2, 6));
+  // Automatów bit-sliced nie da się łączyć ze zwykłymi, a zakresy liczone są w słowach
+  ASSERT(ma_connect(sb, 0, a[0], 0, 8) == -1 && errno == EINVAL);
+  ASSERT(ma_connect(sb, 4, sa, 0, 8) == -1 && errno == EINVAL);
+
+  for (size_t step = 0; step < STEPS; ++step) {
+    for (size_t j = 0; j < L; ++j) {
+      in[j] = rd(0, 255);
+      CALL(ma_set_input(a[j], &in[j]));
+    }
+    CALL(ma_slice_pack(packed_in, in, 8));
+    CALL(ma_set_input(sa, packed_in));
+    if (step == STEPS / 2) {
+      for (size_t j = 0; j < L; ++j)
+        CALL(ma_disconnect(b[j], 1, 3));
+      CALL(ma_disconnect(sb, 1, 3));
+    }
+    CALL(ma_step(all, 2 * L));
+    moore_t *both[] = {sa, sb};
+    CALL(ma_step(both, 2));
+
+    CALL(ma_slice_unpack(out, ma_get_output(sa), 8));
+    for (size_t j = 0; j < L; ++j)
+      ASSERT(out[j] == ma_get_output(a[j])[0]);
+    CALL(ma_slice_unpack(out, ma_get_output(sb), 8));
+    for (size_t j = 0; j < L; ++j)
+      ASSERT(out[j] == ma_get_output(b[j])[0]);
+  }
+
+  for (size_t j = 0; j < L; ++j) {
+    ma_delete(a[j]);
+    ma_delete(b[j]);
+  }
+  ma_delete(sa);
+  ma_delete(sb);
+  return PASS;
+}
+
+// Tablice wspólne dla automatów tablicowych i funkcji, które je odczytują
+static uint16_t lut_next[1 << 11];
+static uint64_t lut_out[1 << 6];
+
+static void t_lookup(uint64_t *next_state, uint64_t const *input,
+                     uint64_t const *state, size_t n, size_t s) {
+  next_state[0] = lut_next[(input[0] & 0x1f) | (state[0] & 0x3f) << 5];
+}
+
+static void y_lookup(uint64_t *output, uint64_t const *state, size_t m, size_t s) {
+  output[0] = lut_out[state[0] & 0x3f] & 0x7f;
+}
+
+static int table(void) {
+  const size_t K = 50, STEPS = 40;
+  moore_t *all[2 * K], **a = all, **b = all + K;
+  uint64_t q[K], in[K];
+
+  for (size_t i = 0; i < (1 << 11); ++i)
+    lut_next[i] = (uint16_t)rd(0, 63);
+  for (size_t i = 0; i < (1 << 6); ++i)
+    lut_out[i] = rd(0, 127);
+  for (size_t i = 0; i < K; ++i) {
+    q[i] = rd(0, 63);
+    a[i] = ma_create_full(5, 7, 6, t_lookup, y_lookup, &q[i]);
+    b[i] = ma_create_table(5, 7, 6, lut_next, lut_out, &q[i]);
+    assert(a[i] && b[i]);
+    ASSERT(ma_get_output(a[i])[0] == ma_get_output(b[i])[0]);
+  }
+  ASSERT(ma_create_table(9, 7, 8, lut_next, lut_out, q) == NULL && errno == EINVAL);
+  ASSERT(ma_create_table(5, 65, 6, lut_next, lut_out, q) == NULL && errno == EINVAL);
+  // Suma szerokości nie może się przekręcić
+  ASSERT(ma_create_table(SIZE_MAX, 7, 1, lut_next, lut_out, q) == NULL && errno == EINVAL);
+  ASSERT(ma_create_table((size_t)1 << 63, 7, (size_t)1 << 63, lut_next, lut_out, q) == NULL && errno == EINVAL);
+  for (size_t i = 0; i < K; ++i) {
+    CALL(ma_connect(a[i], 0, a[(i + 1) % K], 1, 3));
+    CALL(ma_connect(b[i], 0, b[(i + 1) % K], 1, 3));
+  }
+
+  for (size_t step = 0; step < STEPS; ++step) {
+    for (size_t i = 0; i < K; ++i) {
+      in[i] = rd(0, 31);
+      CALL(ma_set_input(a[i], &in[i]));
+      CALL(ma_set_input(b[i], &in[i]));
+    }
+    if (step == STEPS / 2) {
+      // Usunięcie części automatów nie może zwolnić tablic pozostałym
+      for (size_t i = 0; i < K; i += 2) {
+        ma_delete(b[i]);
+        b[i] = ma_create_table(5, 7, 6, lut_next, lut_out, &q[i]);
+        assert(b[i]);
+        ma_delete(a[i]);
+        a[i] = ma_create_full(5, 7, 6, t_lookup, y_lookup, &q[i]);
+        assert(a[i]);
+      }
+    }
+    CALL(ma_step(all, 2 * K));
+    for (size_t i = 0; i < K; ++i)
+      ASSERT(ma_get_output(a[i])[0] == ma_get_output(b[i])[0]);
+  }
+
+  for (size_t i = 0; i < 2 * K; ++i)
+    ma_delete(all[i]);
+  return PASS;
+}
+
+static void t_lookup_counted(uint64_t *next_state, uint64_t const *input,
+                             uint64_t const *state, size_t n, size_t s) {
+  ++t_calls;
+  t_lookup(next_state, input, state, n, s);
+}
+
+static void y_lookup_counted(uint64_t *output, uint64_t const *state, size_t m, size_t s) {
+  ++y_calls;
+  y_lookup(output, state, m, s);
+}
+
+// Funkcje oznaczone jako czyste są próbkowane raz, a potem krok korzysta tylko z tablic
+static int pure(void) {
+  const size_t K = 20, STEPS = 30;
+  moore_t *all[2 * K], **a = all, **b = all + K;
+  uint64_t q[K], in[K];
+
+  for (size_t i = 0; i < (1 << 11); ++i)
+    lut_next[i] = (uint16_t)rd(0, 63);
+  for (size_t i = 0; i < (1 << 6); ++i)
+    lut_out[i] = rd(0, 127);
+  for (size_t i = 0; i < K; ++i) {
+    q[i] = rd(0, 63);
+    a[i] = ma_create_full(5, 7, 6, t_lookup, y_lookup, &q[i]);
+    b[i] = ma_create_full(5, 7, 6, t_lookup_counted, y_lookup_counted, &q[i]);
+    assert(a[i] && b[i]);
+    t_calls = 0;
+    CALL(ma_set_flags(b[i], MA_PURE));
+    ASSERT(t_calls == (1 << 11));
+  }
+  for (size_t i = 0; i < K; ++i) {
+    CALL(ma_connect(a[i], 0, a[(i + K - 1) % K], 0, 5));
+    CALL(ma_connect(b[i], 0, b[(i + K - 1) % K], 0, 5));
+  }
+  ASSERT(ma_set_flags(b[0], MA_PURE | MA_TIME_DEPENDENT) == -1 && errno == EINVAL);
+
+  for (size_t step = 0; step < STEPS; ++step) {
+    if (step == STEPS / 2) {
+      // Bez flagi automat wraca do funkcji użytkownika
+      for (size_t i = 0; i < K; i += 2)
+        CALL(ma_set_flags(b[i], 0));
+    }
+    t_calls = y_calls = 0;
+    for (size_t i = 0; i < K; ++i) {
+      in[i] = rd(0, 31);
+      CALL(ma_set_input(a[i], &in[i]));
+      CALL(ma_set_input(b[i], &in[i]));
+    }
+    CALL(ma_step(all, 2 * K));
+    for (size_t i = 0; i < K; ++i)
+      ASSERT(ma_get_output(a[i])[0] == ma_get_output(b[i])[0]);
+    ASSERT(step < STEPS / 2 ? t_calls == 0 && y_calls == 0 : t_calls == K / 2);
+  }
+
+  // Za szerokie automaty zostają przy funkcjach
+  uint64_t zero[2] = {0, 0};
+  moore_t *wide = ma_create_full(64, 64, 64, t_or_counted, my_identity, zero);
+  assert(wide);
+  CALL(ma_set_flags(wide, MA_PURE));
+  CALL(ma_set_input(wide, zero));
+  t_calls = 0;
+  CALL(ma_step(&wide, 1));
+  ASSERT(t_calls == 1);
+  ma_delete(wide);
+
+  for (size_t i = 0; i < 2 * K; ++i)
+    ma_delete(all[i]);
+  return PASS;
+}
+
+// Buduje netlistę logiki t_logic z powtórzeniami, stałymi i martwymi bramkami do wycięcia
+static ma_netlist_t * logic_netlist(void) {
+  ma_netlist_t *nl = ma_netlist_create(8, 8, 8);
+  assert(nl);
+  int one = ma_netlist_const(nl, 1), zero = ma_netlist_const(nl, 0);
+  for (size_t i = 0; i < 8; ++i) {
+    int s7 = ma_netlist_state(nl, (i + 7) % 8), s3 = ma_netlist_state(nl, (i + 3) % 8);
+    int x = ma_netlist_input(nl, i), next;
+    if (i % 2 == 0) {
+      int and = ma_netlist_gate(nl, MA_GATE_AND, x, s3, 0);
+      ma_netlist_gate(nl, MA_GATE_AND, s3, x, 0);
+      next = ma_netlist_gate(nl, MA_GATE_XOR, s7, and, 0);
+      next = ma_netlist_gate(nl, MA_GATE_XOR, next, zero, 0);
+    } else {
+      int both = ma_netlist_gate(nl, MA_GATE_XOR, s7, s3, 0);
+      next = ma_netlist_gate(nl, MA_GATE_MUX, x, both, s7);
+      next = ma_netlist_gate(nl, MA_GATE_NOT, ma_netlist_gate(nl, MA_GATE_NOT, next, 0, 0), 0, 0);
+    }
+    ma_netlist_gate(nl, MA_GATE_OR, x, s3, 0);
+    assert(next >= 0);
+    int out = ma_netlist_gate(nl, MA_GATE_AND, ma_netlist_state(nl, i), one, 0);
+    if (ma_netlist_next(nl, i, next) || ma_netlist_output(nl, i, out)) {
+      ma_netlist_delete(nl);
+      return NULL;
+    }
+  }
+  return nl;
+}
+
+static int netlist(void) {
+  const size_t K = 30, STEPS = 30;
+  moore_t *all[2 * K + 2], **a = all, **b = all + K;
+  uint64_t q[K], in[K];
+
+  ma_netlist_t *nl = logic_netlist();
+  assert(nl);
+  for (size_t i = 0; i < K; ++i) {
+    q[i] = rd(0, 255);
+    a[i] = ma_create_full(8, 8, 8, t_logic, my_identity, &q[i]);
+    b[i] = ma_create_netlist(nl, &q[i]);
+    assert(a[i] && b[i]);
+  }
+  for (size_t i = 0; i < K; ++i) {
+    CALL(ma_connect(a[i], 0, a[(i + 1) % K], 2, 6));
+    CALL(ma_connect(b[i], 0, b[(i + 1) % K], 2, 6));
+  }
+  uint64_t packed_q[8], packed_in[8];
+  for (size_t i = 0; i < 8; ++i)
+    packed_q[i] = (uint64_t)rd(0, UINT32_MAX) << 32 | rd(0, UINT32_MAX);
+  all[2 * K] = ma_create_sliced(8, 8, 8, t_logic_sliced, y_sliced, packed_q);
+  all[2 * K + 1] = ma_create_netlist_sliced(nl, packed_q);
+  assert(all[2 * K] && all[2 * K + 1]);
+
+  // Wyjście zależne od wejścia i argument spoza netlisty są błędne
+  int x = ma_netlist_input(nl, 0);
+  CALL(ma_netlist_output(nl, 0, x));
+  ASSERT(ma_create_netlist(nl, q) == NULL && errno == EINVAL);
+  ASSERT(ma_netlist_gate(nl, MA_GATE_AND, x, x + 1, 0) == -1 && errno == EINVAL);
+  ma_netlist_delete(nl);
+
+  for (size_t step = 0; step < STEPS; ++step) {
+    for (size_t i = 0; i < K; ++i) {
+      in[i] = rd(0, 255);
+      CALL(ma_set_input(a[i], &in[i]));
+      CALL(ma_set_input(b[i], &in[i]));
+    }
+    for (size_t i = 0; i < 8; ++i)
+      packed_in[i] = (uint64_t)rd(0, UINT32_MAX) << 32 | rd(0, UINT32_MAX);
+    CALL(ma_set_input(all[2 * K], packed_in));
+    CALL(ma_set_input(all[2 * K + 1], packed_in));
+    CALL(ma_step(all, 2 * K + 2));
+    for (size_t i = 0; i < K; ++i)
+      ASSERT(ma_get_output(a[i])[0] == ma_get_output(b[i])[0]);
+    ASSERT(memcmp(ma_get_output(all[2 * K]), ma_get_output(all[2 * K + 1]), 8 * sizeof(uint64_t)) == 0);
+  }
+
+  for (size_t i = 0; i < 2 * K + 2; ++i)
+    ma_delete(all[i]);
+  return PASS;
+}
+
+// Łączny rozmiar anonimowych obszarów pamięci z prawem wykonania, 0 gdy nie da się go odczytać
+static size_t executable_bytes(void) {
+  FILE *f = fopen("/proc/self/maps", "r");
+  char line[512], perms[8];
+  unsigned long lo, hi, inode;
+  int path = 0;
+  size_t bytes = 0;
+  if (!f)
+    return 0;
+  while (fgets(line, sizeof line, f)) {
+    if (sscanf(line, "%lx-%lx %7s %*s %*s %lu %n", &lo, &hi, perms, &inode, &path) >= 4 &&
+        perms[2] == 'x' && inode == 0 && (line[path] == '\n' || line[path] == '\0'))
+      bytes += hi - lo;
+  }
+  fclose(f);
+  return bytes;
+}
+
+// Losowa bramka na węzłach [lo, hi)
+static int random_gate(ma_netlist_t *nl, int lo, int hi) {
+  int op = (int)rd(MA_GATE_AND, MA_GATE_MUX);
+  return ma_netlist_gate(nl, op, (int)rd(lo, hi - 1), (int)rd(lo, hi - 1), (int)rd(lo, hi - 1));
+}
+
+// Automaty z kodu maszynowego muszą liczyć bit w bit to samo co interpreter, także
+// ze stanem i wyjściem dłuższymi niż jedno słowo
+static int jit(void) {
+  const size_t N = 20, M = 70, S = 90, STEPS = 40;
+  ma_netlist_t *nl = ma_netlist_create(N, M, S);
+  assert(nl);
+
+  int first = ma_netlist_const(nl, 0);
+  ma_netlist_const(nl, 1);
+  for (size_t i = 0; i < S; ++i)
+    ma_netlist_state(nl, i);
+  // Węzły do state_end zależą tylko od stanu, więc mogą liczyć wyjście
+  for (size_t i = 0; i < 300; ++i)
+    random_gate(nl, first, ma_netlist_state(nl, rd(0, S - 1)));
+  int state_end = ma_netlist_const(nl, 0);
+  for (size_t i = 0; i < N; ++i)
+    ma_netlist_input(nl, i);
+  for (size_t i = 0; i < 600; ++i)
+    random_gate(nl, first, ma_netlist_input(nl, rd(0, N - 1)));
+  int end = ma_netlist_const(nl, 1);
+  for (size_t i = 0; i < M; ++i)
+    CALL(ma_netlist_output(nl, i, (int)rd(state_end / 2, state_end)));
+  for (size_t i = 0; i < S; ++i)
+    CALL(ma_netlist_next(nl, i, (int)rd(end / 2, end)));
+
+  uint64_t q[2], packed_q[S], in[1], packed_in[N];
+  q[0] = (uint64_t)rd(0, UINT32_MAX) << 32 | rd(0, UINT32_MAX);
+  q[1] = rd(0, UINT32_MAX);
+  for (size_t i = 0; i < S; ++i)
+    packed_q[i] = (uint64_t)rd(0, UINT32_MAX) << 32 | rd(0, UINT32_MAX);
+  moore_t *at[4];
+  CALL(ma_set_jit(0));
+  at[0] = ma_create_netlist(nl, q);
+  at[1] = ma_create_netlist_sliced(nl, packed_q);
+  CALL(ma_set_jit(1));
+  at[2] = ma_create_netlist(nl, q);
+  at[3] = ma_create_netlist_sliced(nl, packed_q);
+  assert(at[0] && at[1] && at[2] && at[3]);
+  ASSERT(ma_get_jit(at[0]) == 0 && ma_get_jit(at[1]) == 0);
+#if defined(__x86_64__) && !defined(_WIN32)
+  // Na x86-64 z System V kod maszynowy musi faktycznie powstać, a nie zostać po cichu zastąpiony interpreterem
+  ASSERT(ma_get_jit(at[2]) == 1 && ma_get_jit(at[3]) == 1);
+
+  // Automaty z tej samej netlisty dzielą jeden kod, więc nie zajmują po stronie pamięci każdy
+  moore_t *many[1000];
+  size_t code = executable_bytes();
+  for (size_t i = 0; i < 1000; ++i) {
+    many[i] = ma_create_netlist(nl, q);
+    assert(many[i]);
+    ASSERT(ma_get_jit(many[i]) == 1);
+  }
+  ASSERT(executable_bytes() < code + 64 * 1024);
+  for (size_t i = 0; i < 1000; ++i)
+    ma_delete(many[i]);
+#endif
+  CALL(ma_set_jit(0));
+  ma_netlist_delete(nl);
+
+  for (size_t step = 0; step < STEPS; ++step) {
+    in[0] = rd(0, (1 << N) - 1);
+    for (size_t i = 0; i < N; ++i)
+      packed_in[i] = (uint64_t)rd(0, UINT32_MAX) << 32 | rd(0, UINT32_MAX);
+    CALL(ma_set_input(at[0], in));
+    CALL(ma_set_input(at[2], in));
+    CALL(ma_set_input(at[1], packed_in));
+    CALL(ma_set_input(at[3], packed_in));
+    CALL(ma_step(at, 4));
+    ASSERT(memcmp(ma_get_output(at[0]), ma_get_output(at[2]), 2 * sizeof(uint64_t)) == 0);
+    ASSERT(memcmp(ma_get_output(at[1]), ma_get_output(at[3]), M * sizeof(uint64_t)) == 0);
+  }
+
+  for (size_t i = 0; i < 4; ++i)
+    ma_delete(at[i]);
+  return PASS;
+}
+
 // Testuje reakcję implementacji na niepowodzenie alokacji pamięci.
 static int memory(void) {
   memory_tests_check();
@@ -565,6 +1634,24 @@ static const test_list_t test_list[] = {
   TEST(two),
   TEST(memory),
   TEST(counter_test),
+  TEST(threads),
+  TEST(step_n),
+  TEST(cached_output),
+  TEST(fan_out),
+  TEST(delete_wide),
+  TEST(rewire_churn),
+  TEST(network),
+  TEST(group),
+  TEST(event_driven),
+  TEST(sparse_bus),
+  TEST(group_event),
+  TEST(push),
+  TEST(family),
+  TEST(sliced),
+  TEST(table),
+  TEST(pure),
+  TEST(netlist),
+  TEST(jit),
   TEST(connection_stress)
 };
 